@@ -0,0 +1,150 @@
+#ifndef BODYSTORE_H
+#define BODYSTORE_H
+
+#include <vector>
+#include <cstdint>
+#include "body.h"
+#include "../utils/FirstTouch.h"
+
+class BodyStore;
+struct Bounds;
+
+// Handle to one body inside a BodyStore, with the same getters and setters as Body.
+// Only valid until bodies are added, removed or reordered
+template <typename Store>
+class BasicBodyRef {
+    private:
+    Store* m_store;
+    size_t m_index;
+
+    public:
+    BasicBodyRef(Store* store, size_t index) : m_store(store), m_index(index) {}
+
+    // A writable handle can be used where a read-only one is expected
+    template <typename Other>
+    BasicBodyRef(const BasicBodyRef<Other>& other) : m_store(other.store()), m_index(other.index()) {}
+
+    Store* store() const { return m_store; }
+    size_t index() const { return m_index; }
+
+    // Getters
+    Vec2 getPos() const { return Vec2(m_store->m_x[m_index], m_store->m_y[m_index]); }
+    Vec2 getVel() const { return Vec2(m_store->m_vx[m_index], m_store->m_vy[m_index]); }
+    Vec2 getAcc() const { return Vec2(m_store->m_ax[m_index], m_store->m_ay[m_index]); }
+    double getMass() const { return m_store->m_mass[m_index]; }
+    double getRadius() const { return m_store->m_radius[m_index]; }
+    Color getColor() const { return m_store->m_color[m_index]; }
+    uint32_t getId() const { return m_store->m_id[m_index]; }
+
+    // Setters, only usable on a BodyRef
+    void setPos(Vec2 pos) const { m_store->m_x[m_index] = pos.getX(); m_store->m_y[m_index] = pos.getY(); }
+    void setVel(Vec2 vel) const { m_store->m_vx[m_index] = vel.getX(); m_store->m_vy[m_index] = vel.getY(); }
+    void setAcc(Vec2 acc) const { m_store->m_ax[m_index] = acc.getX(); m_store->m_ay[m_index] = acc.getY(); }
+    void setMass(double mass) const { m_store->m_mass[m_index] = mass; }
+    void setRadius(double radius) const { m_store->m_radius[m_index] = radius; }
+};
+
+using BodyRef = BasicBodyRef<BodyStore>;
+using ConstBodyRef = BasicBodyRef<const BodyStore>;
+
+// Bodies as structure of arrays: one contiguous array per field, so the integrator and the
+// force phase only stream the fields they use. Body stays the value type for creating,
+// saving and loading bodies; BodyRef stands in for Body& on stored ones.
+//
+// Every body gets an id when inserted that stays valid however bodies move in the arrays.
+// An id is a slot in a handle table, which holds the body's current index, plus the slot's
+// generation, which changes when the body is removed so stale ids stop matching
+class BodyStore {
+    template <typename Store> friend class BasicBodyRef;
+
+    public:
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+    // Low bits of an id are the slot, high bits its generation. NO_BODY_ID is never handed out
+    static constexpr uint32_t SLOT_BITS = 22;
+    static constexpr uint32_t MAX_BODIES = (1u << SLOT_BITS) - 1;
+
+    private:
+    FieldVector<double> m_x;        // Position in AU
+    FieldVector<double> m_y;
+    FieldVector<double> m_vx;       // Velocity in AU/yr
+    FieldVector<double> m_vy;
+    FieldVector<double> m_ax;       // Acceleration in AU/yr²
+    FieldVector<double> m_ay;
+    FieldVector<double> m_mass;     // Solar masses
+    FieldVector<double> m_radius;   // AU
+    FieldVector<Color> m_color;
+    FieldVector<uint32_t> m_id;
+
+    // Handle table, indexed by slot
+    std::vector<uint32_t> m_slotIndex;      // Index of the body holding the slot
+    std::vector<uint32_t> m_slotGeneration; // Bumped every time the slot is freed
+    std::vector<uint32_t> m_freeSlots;
+
+    // Reused by permute()
+    FieldVector<double> m_scratch;
+    FieldVector<Color> m_colorScratch;
+    FieldVector<uint32_t> m_idScratch;
+
+    // Give the slot back, so ids pointing at it stop matching
+    void freeSlot(uint32_t id);
+
+    public:
+    size_t size() const { return m_x.size(); }
+    bool empty() const { return m_x.empty(); }
+    size_t capacity() const { return m_x.capacity(); } // Every field grows with m_x
+    void reserve(size_t count);
+
+    // Remove every body. Their ids stay invalid, also once the slots are reused
+    void clear();
+
+    // Append a copy of body under a new id and return the id. Fails with NO_BODY_ID
+    // beyond MAX_BODIES bodies
+    uint32_t insert(const Body& body);
+
+    // Remove body i by moving the last body into its place, O(1)
+    void remove(size_t i);
+
+    // Current index of the body with this id, or NOT_FOUND if it was removed
+    size_t indexOf(uint32_t id) const;
+
+    // Copy body i out as a Body
+    Body get(size_t i) const;
+
+    // Reorder the bodies so that the body at index[i] moves to i. Ids keep their bodies
+    void permute(const std::vector<uint32_t>& index);
+
+    // Move every field, and the permute() scratch it is swapped with, onto the NUMA nodes of
+    // the workers that loop over it, see ::placeOnWorkers
+    void placeOnWorkers(ThreadPool& pool, size_t grain);
+
+    BodyRef operator[](size_t i) { return BodyRef(this, i); }
+    ConstBodyRef operator[](size_t i) const { return ConstBodyRef(this, i); }
+
+    // Leapfrog integration steps for bodies [first, last)
+    void kick(years_t dt, size_t first, size_t last);  // v += a * dt
+    void drift(years_t dt, size_t first, size_t last); // x += v * dt
+    // A kick by kickDt then a drift by driftDt in one pass, adding the new positions to bounds
+    void kickDrift(years_t kickDt, years_t driftDt, size_t first, size_t last, Bounds& bounds);
+
+    // Raw field arrays for loops over every body
+    double* x() { return m_x.data(); }
+    double* y() { return m_y.data(); }
+    double* vx() { return m_vx.data(); }
+    double* vy() { return m_vy.data(); }
+    double* ax() { return m_ax.data(); }
+    double* ay() { return m_ay.data(); }
+    double* mass() { return m_mass.data(); }
+    double* radius() { return m_radius.data(); }
+    const double* x() const { return m_x.data(); }
+    const double* y() const { return m_y.data(); }
+    const double* vx() const { return m_vx.data(); }
+    const double* vy() const { return m_vy.data(); }
+    const double* ax() const { return m_ax.data(); }
+    const double* ay() const { return m_ay.data(); }
+    const double* mass() const { return m_mass.data(); }
+    const double* radius() const { return m_radius.data(); }
+    const Color* color() const { return m_color.data(); }
+    const uint32_t* id() const { return m_id.data(); }
+};
+
+#endif // BODYSTORE_H
@@ -0,0 +1,70 @@
+#ifndef LOCKINGTHREADPOOL_H
+#define LOCKINGTHREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+// The original pool: one queue behind one mutex, workers woken through condition variables.
+// Same interface as ThreadPool, kept to benchmark the work-stealing pool against
+class LockingThreadPool {
+public:
+    // Most bytes a task's captures may take. Tasks are stored inline in the queue, so
+    // submitting one never allocates
+    static constexpr size_t TASK_CAPACITY = 64;
+
+    LockingThreadPool(size_t numThreads);
+    ~LockingThreadPool();
+    
+    // Submit a task to the pool. Tasks are copied as plain bytes, so capture pointers,
+    // references and numbers only, and point at anything larger
+    template <typename F>
+    void enqueue(F task) {
+        static_assert(sizeof(F) <= TASK_CAPACITY, "task captures too much, capture a pointer to the state instead");
+        static_assert(alignof(F) <= alignof(std::max_align_t), "task captures an over-aligned type");
+        static_assert(std::is_trivially_copyable<F>::value && std::is_trivially_destructible<F>::value,
+                      "task captures must be trivially copyable");
+
+        Task entry;
+        new (entry.storage) F(task);
+        entry.run = [](void* storage) { (*std::launder(static_cast<F*>(storage)))(); };
+        push(entry);
+    }
+    
+    // Wait for all tasks to complete
+    void wait();
+    
+    // Prevent copying
+    LockingThreadPool(const LockingThreadPool&) = delete;
+    LockingThreadPool(LockingThreadPool&&) = delete;
+    LockingThreadPool& operator=(const LockingThreadPool&) = delete;
+    LockingThreadPool& operator=(LockingThreadPool&&) = delete;
+    
+private:
+    // A callable and the function that calls it
+    struct Task {
+        alignas(std::max_align_t) unsigned char storage[TASK_CAPACITY];
+        void (*run)(void*);
+    };
+
+    void push(const Task& task);
+
+    std::vector<std::thread> m_workers; // Worker threads
+    std::vector<Task> m_tasks; // Task queue as a ring buffer, only grows when full
+    size_t m_head = 0; // Index of the oldest queued task in m_tasks
+    
+    std::mutex m_queueMutex; // Mutex for task queue
+    std::condition_variable m_condition; // Condition variable for task availability
+    std::condition_variable m_waitCondition; // Condition variable for wait() method
+    
+    std::atomic<bool> m_stop; // Atomic flag to stop the pool
+    std::atomic<size_t> m_activeTasks; // Atomic count of active tasks
+    std::atomic<size_t> m_queuedTasks; // Atomic count of queued tasks
+};
+
+#endif // LOCKINGTHREADPOOL_H
@@ -24,7 +24,7 @@ private:
     bool isOpen_ = false;
     
     // State
-    Body* selectedBody_ = nullptr; // TODO: May change because of possible invalid pointers when bodies are removed
+    uint32_t selectedId_ = NO_BODY_ID; // Id rather than pointer, bodies move when the simulation reorders them
     SidebarTab currentTab_ = SidebarTab::INSPECTOR;
     Simulation& simulation_;
     TimeManager& timeManager_;
@@ -54,10 +54,10 @@ public:
     void openCreationMenu(Vec2 worldPos);
 
     // Selection logic
-    void selectBody(Body* body);
+    void selectBody(uint32_t id);
     void deselect();
     bool isMouseOver(); // Helper to prevent clicking through the UI
-    bool hasSelection() const { return selectedBody_ != nullptr; }
+    bool hasSelection() const;
     bool isEditing() const { return nameEditMode_; }
     void toggleInfo();
 };
@@ -3,40 +3,222 @@
 
 #include <vector>
 #include <thread>
-#include <queue>
 #include <mutex>
 #include <condition_variable>
-#include <functional>
 #include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <algorithm>
 
+// How parallelFor() splits its range between the threads
+enum class Schedule {
+    Static,  // One contiguous range per thread, for loops where every index costs the same
+    Dynamic, // Threads take grain-sized chunks from a shared counter until none are left
+    Guided   // Like Dynamic, but chunks start at a share of what is left and shrink to grain
+};
+
+// Work-stealing pool. Every worker has its own lock-free queue; submitted tasks are dealt to
+// the queues in turn, a worker runs its own queue first and then takes from the others, and
+// wait() runs queued tasks on the calling thread while it waits. Completion is one atomic
+// counter, so neither submitting nor finishing a task takes a lock. Idle workers spin
+// briefly, then sleep until the next submission
 class ThreadPool {
 public:
+    // Most bytes a task's captures may take. Tasks are stored inline in the queue, so
+    // submitting one never allocates
+    static constexpr size_t TASK_CAPACITY = 64;
+
     ThreadPool(size_t numThreads);
     ~ThreadPool();
-    
-    // Submit a task to the pool
-    void enqueue(std::function<void()> task);
-    
-    // Wait for all tasks to complete
+
+    // Submit a task to the pool. Tasks are copied as plain bytes, so capture pointers,
+    // references and numbers only, and point at anything larger
+    template <typename F>
+    void enqueue(F task) {
+        push(wrap(task), ANY_QUEUE);
+    }
+
+    // Wait for all tasks to complete, helping with the ones still queued
     void wait();
-    
+
+    // Call fn(first, last, slot) on chunks covering [begin, end) and return once all are done.
+    // Chunks hold at least grain indices, except the last. Every slot, below getThreadCount(),
+    // runs on one thread at a time, so fn can keep per-slot scratch without locking. Slot s is
+    // queued on worker s, so a static loop gives a worker the same range every time. fn is
+    // called directly, not through a std::function, and only pointers to it and to the loop
+    // state on this stack are submitted, so nothing is allocated. Not for use inside a task
+    template <typename F>
+    void parallelFor(size_t begin, size_t end, size_t grain, F&& fn, Schedule schedule = Schedule::Static) {
+        if (begin >= end) return;
+        grain = std::max<size_t>(grain, 1);
+        size_t count = end - begin;
+        size_t slots = getSlotCount(count, grain);
+
+        using Body = std::remove_reference_t<F>;
+        Body* body = &fn;
+        if (slots <= 1) {
+            fn(begin, end, size_t(0));
+            return;
+        }
+
+        if (schedule == Schedule::Static) {
+            size_t perSlot = (count + slots - 1) / slots;
+            for (size_t slot = 0; slot < slots; ++slot) {
+                size_t first = begin + slot * perSlot;
+                size_t last = std::min(first + perSlot, end);
+                if (first >= last) break;
+                push(wrap([body, first, last, slot]() { (*body)(first, last, slot); }), slot);
+            }
+            wait();
+            return;
+        }
+
+        LoopState state(begin, end, grain, schedule == Schedule::Guided ? 2 * slots : 0);
+        LoopState* shared = &state;
+        for (size_t slot = 0; slot < slots; ++slot) {
+            push(wrap([body, shared, slot]() {
+                size_t first;
+                size_t last;
+                while (shared->claim(first, last)) {
+                    (*body)(first, last, slot);
+                }
+            }), slot);
+        }
+        wait();
+    }
+
+    // Pin worker i to CPU cpus[i % cpus.size()], or let every worker run anywhere again with an
+    // empty list. Returns once all workers have applied it, false if any could not be pinned.
+    // While pinned, wait() leaves queued tasks to the workers instead of running them itself,
+    // so a task meant for a worker's node is not run on the submitting thread's
+    bool setAffinity(const std::vector<int>& cpus);
+    bool isPinned() const { return m_pinned.load(std::memory_order_relaxed); }
+
+    // Number of slots parallelFor() spreads a loop over
+    size_t getThreadCount() const { return m_queueCount; }
+
+    // Slots a loop over count indices with this grain uses, one per chunk up to getThreadCount()
+    size_t getSlotCount(size_t count, size_t grain) const {
+        grain = std::max<size_t>(grain, 1);
+        return std::min(m_queueCount, (count + grain - 1) / grain);
+    }
+
     // Prevent copying
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool(ThreadPool&&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
     ThreadPool& operator=(ThreadPool&&) = delete;
-    
+
 private:
+    // A callable and the function that calls it
+    struct Task {
+        alignas(std::max_align_t) unsigned char storage[TASK_CAPACITY];
+        void (*run)(void*);
+    };
+
+    static constexpr size_t TASK_WORDS = sizeof(Task) / sizeof(uint64_t);
+    static_assert(sizeof(Task) % sizeof(uint64_t) == 0, "tasks are copied as whole words");
+
+    // Bounded queue of one worker. Only the submitting thread adds at bottom, any thread takes
+    // from top by advancing it with a compare-exchange. Tasks are kept as atomic words, so a
+    // taker reading a slot that is being refilled gets a torn copy and a failed exchange,
+    // never a data race
+    struct alignas(64) WorkerQueue {
+        static constexpr size_t CAPACITY = 256;
+
+        std::atomic<uint64_t> top{0};
+        alignas(64) std::atomic<uint64_t> bottom{0};
+        alignas(64) std::atomic<uint64_t> slots[CAPACITY][TASK_WORDS];
+
+        bool tryPush(const Task& task);
+        bool tryTake(Task& task);
+        bool hasWork() const;
+    };
+
+    // Next index of a Dynamic or Guided loop, shared by its tasks
+    struct LoopState {
+        alignas(64) std::atomic<size_t> next;
+        size_t end;
+        size_t grain;
+        size_t divisor; // Guided chunks are the remaining indices over this, 0 for Dynamic
+
+        LoopState(size_t begin, size_t end, size_t grain, size_t divisor)
+            : next(begin), end(end), grain(grain), divisor(divisor) {}
+
+        // Take the next chunk, false once the range is used up
+        bool claim(size_t& first, size_t& last) {
+            if (divisor == 0) {
+                first = next.fetch_add(grain, std::memory_order_relaxed);
+                if (first >= end) return false;
+                last = std::min(first + grain, end);
+                return true;
+            }
+
+            first = next.load(std::memory_order_relaxed);
+            do {
+                if (first >= end) return false;
+                last = std::min(first + std::max(grain, (end - first) / divisor), end);
+            } while (!next.compare_exchange_weak(first, last, std::memory_order_relaxed));
+            return true;
+        }
+    };
+
+    static constexpr size_t ANY_QUEUE = static_cast<size_t>(-1);
+
+    template <typename F>
+    static Task wrap(const F& task) {
+        static_assert(sizeof(F) <= TASK_CAPACITY, "task captures too much, capture a pointer to the state instead");
+        static_assert(alignof(F) <= alignof(std::max_align_t), "task captures an over-aligned type");
+        static_assert(std::is_trivially_copyable<F>::value && std::is_trivially_destructible<F>::value,
+                      "task captures must be trivially copyable");
+
+        Task entry;
+        new (entry.storage) F(task);
+        entry.run = [](void* storage) { (*std::launder(static_cast<F*>(storage)))(); };
+        return entry;
+    }
+
+    // Queue a task on worker queue (modulo the worker count), or deal it to the next queue in
+    // turn with ANY_QUEUE. A full queue passes the task on to the following one
+    void push(const Task& task, size_t queue);
+
+    // Take one task, trying queue `first` before the others, and run it
+    bool runOne(size_t first);
+
+    void workerLoop(size_t index);
+    bool hasWork() const;
+
+    // Pin worker index as setAffinity() last asked, if it has not yet
+    void applyAffinity(size_t index);
+    bool affinityChanged(size_t index) const;
+
     std::vector<std::thread> m_workers; // Worker threads
-    std::queue<std::function<void()>> m_tasks; // Task queue
-    
-    std::mutex m_queueMutex; // Mutex for task queue
-    std::condition_variable m_condition; // Condition variable for task availability
-    std::condition_variable m_waitCondition; // Condition variable for wait() method
-    
-    std::atomic<bool> m_stop; // Atomic flag to stop the pool
-    std::atomic<size_t> m_activeTasks; // Atomic count of active tasks
-    std::atomic<size_t> m_queuedTasks; // Atomic count of queued tasks
+    std::unique_ptr<WorkerQueue[]> m_queues; // One per worker
+    size_t m_queueCount;
+    size_t m_nextQueue = 0; // Queue the next task goes to
+    std::atomic_flag m_submitLock = ATOMIC_FLAG_INIT; // Keeps submitters one at a time
+
+    std::atomic<size_t> m_pending{0}; // Submitted tasks not finished yet
+
+    // Sleeping workers, woken by push()
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCondition;
+    std::atomic<size_t> m_sleepers{0};
+
+    // CPU each worker should run on and the setAffinity() call it has applied
+    struct alignas(64) WorkerAffinity {
+        std::atomic<int> cpu{-1};
+        std::atomic<uint32_t> applied{0};
+        std::atomic<bool> failed{false};
+    };
+    std::unique_ptr<WorkerAffinity[]> m_affinity;
+    std::atomic<uint32_t> m_affinityVersion{0};
+    std::atomic<bool> m_pinned{false};
+
+    std::atomic<bool> m_stop{false}; // Atomic flag to stop the pool
 };
 
 #endif // THREADPOOL_H
@@ -3,10 +3,36 @@
 
 #include <fstream>
 #include "../utils/constants.h"
+#include "../utils/QuadTree.h"
+#include "simulation.h"
 
 namespace benchmark
 {
-    void runHeadlessBenchmark(int numBodies, double theta, int totalTicks, years_t fixedDeltaT, std::ofstream& csv) ;
+    // Simulation settings a run is made with, each one is written as a CSV column
+    struct Options {
+        TreeBuilder builder = TreeBuilder::Insertion;
+        size_t leafCapacity = 1;
+        bool quadrupole = false;
+        ForceSolver solver = ForceSolver::BarnesHut;
+        size_t groupSize = 32;
+        ForceIsa forceIsa = bestForceIsa();
+        bool mixedPrecision = false;
+        BodyOrdering ordering = BodyOrdering::None;
+        int reorderInterval = 0;
+        OpeningCriterion criterion = OpeningCriterion::Geometric;
+        double listSkin = 0.0;
+        bool collisions = true;
+        bool costBalancing = true;
+        bool pinWorkers = false;
+        size_t directCrossover = 0; // 0 keeps the tree solvers at every N so phases compare them, theta = 0 still sums directly
+    };
+
+    void runHeadlessBenchmark(int numBodies, double theta, int totalTicks, years_t fixedDeltaT, std::ofstream& csv, const Options& options = Options());
+    void runPropagationBenchmark(int numBodies, int repeats, std::ofstream& csv);
+    // Times rounds of submitting tasks to the pool and waiting for them, on LockingThreadPool and ThreadPool
+    void runSchedulerBenchmark(size_t tasks, size_t work, int rounds, std::ofstream& csv);
+    // Steps a ParticleSystem of the given dimension (2 or 3) through a disk or cluster model
+    void runDimensionBenchmark(int dimensions, bool cluster, int numBodies, int totalTicks, years_t fixedDeltaT, std::ofstream& csv);
     void runAllBenchmarks();
 }
 
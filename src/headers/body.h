@@ -3,15 +3,22 @@
 
 #include <utility>
 #include <fstream>
+#include <cstdint>
+#include <limits>
 #include "raylib.h"
 #include "../utils/Vec.h"
 #include "../utils/constants.h"
 
 // Celestial Body
 class Simulation;
+class BodyStore;
+
+// Id no body ever gets, used for "nothing selected"
+const constexpr uint32_t NO_BODY_ID = std::numeric_limits<uint32_t>::max();
 
 class Body {
     friend Simulation;
+    friend BodyStore;
     private:
     double m_mass; // in Solar Masses (M☉)
     double m_radius;
@@ -19,6 +26,7 @@ class Body {
     Vec2 m_velocity; // in AU per Year (AU/yr)
     Vec2 m_acceleration; // in AU/yr²
     Color m_color;
+    uint32_t m_id; // Assigned by BodyStore::insert, stays with the body however the store moves it
     
     public:
     
@@ -54,6 +62,8 @@ class Body {
     Vec2 getAcc() const;
     double getMass() const;
     double getRadius() const;
+    Color getColor() const { return m_color; }
+    uint32_t getId() const { return m_id; }
 
     // For debugging
     friend std::ostream& operator<<(std::ostream& os, const Body& body) {
@@ -63,4 +73,8 @@ class Body {
         return os;
     }
 };
+
+// Draws a body of the given radius at a position in AU, at least 3 pixels wide
+void drawBody(Vec2 position, double radius, Color color);
+
 #endif // BODY_H
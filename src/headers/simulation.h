@@ -2,18 +2,43 @@
 #define SIMULATION_H
 
 #include "body.h"
+#include "BodyStore.h"
 #include "../utils/vec.h"  
 #include <vector>
+#include <optional>
 #include "../utils/constants.h"
 #include "../utils/QuadTree.h"
+#include "../utils/Fmm.h"
+#include "../utils/DirectSum.h"
+#include "../utils/ForceKernel.h"
+#include "../utils/FrameArena.h"
+#include "../utils/BatchMath.h"
 #include "ThreadPool.h"
 
+// How accelerations are computed from the tree each step
+enum class ForceSolver {
+    BarnesHut, // One Quadtree::acc walk per body
+    Fmm,       // Fast multipole expansions on the same tree, see Fmm
+    GroupWalk, // One Quadtree::accGroup walk per group of nearby bodies (per-body walks after insert())
+    Direct     // Exact pairwise sum, see DirectSum. Also used whenever theta is 0 or N is below the crossover
+};
+
+// Space filling curve m_bodies is periodically sorted along, so bodies sharing tree cells
+// also share cache lines during the force phase
+enum class BodyOrdering {
+    None,    // Keep insertion order
+    Morton,  // Z-order, same keys as the Morton tree builders
+    Hilbert  // Hilbert curve, no long jumps between neighbouring quadrants
+};
+
 class Simulation
 {
     private:
-    std::vector<Body> m_bodies;      // Collection of all celestial bodies in the simulation
+    BodyStore m_bodies;              // Collection of all celestial bodies in the simulation
     double m_timeScale;              // Time scaling factor for simulation speed
     Quadtree m_quadtree;             // Barnes-Hut quadtree for efficient force calculations
+    Fmm m_fmm;                       // Multipole solver reusing m_quadtree's nodes
+    DirectSum m_direct;              // Exact solver for small N and theta = 0
     
     // Pre-allocated buffers for O(N) allocation-free spatial hashing
     std::vector<int> m_hashHead;
@@ -23,8 +48,56 @@ class Simulation
     // 1.5 if accuracy doesn't matter, any greater than that significant errors occur.
     double m_theta;
 
+    TreeBuilder m_treeBuilder;       // Which algorithm builds the quadtree each step
+    ForceSolver m_forceSolver;       // Which algorithm turns the tree into accelerations
+    size_t m_groupSize;              // Most bodies sharing one walk with ForceSolver::GroupWalk
+    size_t m_directCrossover;        // Below this many bodies the exact sum is faster than any tree solver
+    bool m_parallelPropagate;        // Propagate the tree level by level on the thread pool
+    double m_refitThreshold;         // Fraction of bodies changing leaf that forces a full rebuild in refit mode
+
+    BodyOrdering m_bodyOrdering;     // Curve m_bodies is sorted along, None disables reordering
+    int m_reorderInterval;           // Steps between reorders, 0 = only when locality degrades
+    double m_reorderThreshold;       // Scatter (see m_scatter) that triggers a reorder early
+    int m_stepsSinceReorder = 0;
+    double m_scatter = 1.0;          // Fraction of tree-adjacent bodies stored far apart, from the last build
+
+    // Reorder scratch, kept to avoid per-reorder allocations
+    std::vector<uint64_t> m_reorderKeys;
+    std::vector<uint32_t> m_reorderIndex;
+    std::vector<uint64_t> m_reorderKeyScratch;
+    std::vector<uint32_t> m_reorderIndexScratch;
+
+    std::vector<uint32_t> m_pendingRemovals; // Ids removed since the last step, see removeBody()
+    std::vector<size_t> m_removalIndices;
+
     size_t m_threadCount;            // Number of threads for parallelization
-    ThreadPool m_threadPool;         // Thread pool for parallel calculations
+    mutable ThreadPool m_threadPool; // Thread pool for parallel calculations, also used by const queries
+    std::vector<InteractionList> m_interactionLists; // Per-thread scratch for the tree walks
+
+    // Buffers that only live for one step come from these, all reset at the start of update()
+    FrameArena m_frameArena;                 // For the calling thread
+    std::vector<FrameArena> m_threadArenas;  // One per task of a parallel phase
+
+    // Force loop balancing. Each walk records how many point masses it summed, and the next
+    // step splits the bodies into one range per thread with equal shares of that cost
+    bool m_costBalancing = true;
+    std::vector<uint32_t> m_bodyCost;     // Interactions of each body's last walk
+    std::vector<uint32_t> m_costScratch;
+    std::vector<size_t> m_costSplits;     // Range p is [m_costSplits[p], m_costSplits[p + 1])
+    std::vector<double> m_slotForceMs;    // Time each slot spent walking in the last force pass
+    double m_forceImbalance = 1.0;
+
+    // Workers pinned to CPUs by NUMA node, with the arrays placed on the nodes of the workers
+    // that process them. Placement is redone when an array was reallocated, whose new pages
+    // were touched by one thread, or the body count moved far enough to shift the ranges
+    bool m_pinWorkers = false;
+    size_t m_placedBodies = 0;
+    size_t m_placedCapacity = 0;      // BodyStore capacity at the last placement
+    size_t m_placedTreeCapacity = 0;  // Capacity of the tree's per-body arrays at the last placement
+
+    // Box around the bodies for this step's tree, built by the drift and widened by collisions
+    Bounds m_stepBounds;
+    std::vector<Bounds> m_slotBounds;     // Each slot's part of the drift
     bool m_toggleWF;                 // A toggle for the wireframe rendering.
 
     // For energy logging
@@ -36,14 +109,36 @@ class Simulation
     // // 0.1 means it logs once every 0.1 simulated years.
     // const double LOG_INTERVAL = .1;
 
-    // double m_lastTreeTimeMs = 0.0;
-    // double m_lastForceCalcTimeMs = 0.0;
-    // double m_lastCollisionTimeMs = 0.0;
+    double m_lastTreeTimeMs = 0.0;
+    double m_lastForceCalcTimeMs = 0.0;
+    double m_lastCollisionTimeMs = 0.0;
+
+    // Rebuilds and propagates the quadtree using the selected builder
+    void buildTree();
+
+    // Sets every body's acceleration with one tree walk per group
+    void computeGroupForces();
+
+    // Whether the reorder interval has passed or the last tree showed too much scatter
+    bool needsReorder() const;
+
+    // Fraction of bodies adjacent in the tree's order that are far apart in m_bodies
+    void measureScatter();
+
+    // Split the bodies, in tree order if order is given, into m_costSplits by m_bodyCost
+    void partitionByCost(const uint32_t* order);
+
+    // Copy the body and tree arrays onto the workers' NUMA nodes, see BodyStore::placeOnWorkers
+    void placeOnWorkers();
+    bool needsPlacement() const;
     
     public:
-    // double getLastTreeBuildTimeMs() const { return m_lastTreeTimeMs; }
-    // double getLastForceCalcTimeMs() const { return m_lastForceCalcTimeMs; }
-    // double getLastCollisionTimeMs() const { return m_lastCollisionTimeMs; }
+    double getLastTreeBuildTimeMs() const { return m_lastTreeTimeMs; }
+    double getLastForceCalcTimeMs() const { return m_lastForceCalcTimeMs; }
+    double getLastCollisionTimeMs() const { return m_lastCollisionTimeMs; }
+    // Slowest thread's force time over the mean of all threads in the last tree walk force
+    // pass, 1 when perfectly balanced
+    double getForceImbalance() const { return m_forceImbalance; }
 
     Simulation( double theta = 0.5 );
     ~Simulation() = default;
@@ -56,18 +151,32 @@ class Simulation
 
     // Methods for collisions
     void handleCollisions();
-    void resolveCollision(Body& b1, Body& b2, double restitution = 0.5);
+    void resolveCollision(BodyRef b1, BodyRef b2, double restitution = 0.5);
     double calculateTotalEnergy() const;
 
     // General Physics
     void update(years_t deltaT, bool enableCollisions = true);
-    Body* addBody(Body body);
+    uint32_t addBody(Body body); // Returns the new body's id, NO_BODY_ID if the store is full
     void render();
     void reset();
     void generateProPlanetaryDisk(int count, Vec2 centerPoint = Vec2(0, 0), Vec2 velocity = Vec2(0, 0), bool centralMass = true);
 
     void DeleteBodyAt(Vec2 worldPos);
-    Body* getBodyAt(Vec2 worldPos);
+
+    // Queue a body for removal. Removals are applied together before the next step or frame,
+    // each moving the last body into the gap, so ids and BodyRefs stay valid until then
+    void removeBody(uint32_t id);
+
+    // Apply queued removals now
+    void applyRemovals();
+    std::optional<BodyRef> getBodyAt(Vec2 worldPos);
+
+    // Body with the given id, or nothing if it was removed, in O(1). Use ids rather than BodyRefs
+    // to keep track of a body across steps, reordering and removals move bodies in m_bodies
+    std::optional<BodyRef> findBody(uint32_t id);
+
+    // Sort m_bodies along the selected curve now. BodyRefs into m_bodies are invalidated
+    void reorderBodies();
 
     // Saving and loading simulation state.
     void saveSimulation(const std::string& filename);
@@ -76,6 +185,47 @@ class Simulation
 
     void setTheta(double theta);
     double getTheta() const { return m_theta; }
+    void setTreeBuilder(TreeBuilder builder) { m_treeBuilder = builder; }
+    TreeBuilder getTreeBuilder() const { return m_treeBuilder; }
+    void setForceSolver(ForceSolver solver) { m_forceSolver = solver; }
+    ForceSolver getForceSolver() const { return m_forceSolver; }
+    // Solver the next update will actually use, Direct when theta is 0 or N is below the crossover
+    ForceSolver getActiveForceSolver() const;
+    void setDirectCrossover(size_t bodies) { m_directCrossover = bodies; }
+    size_t getDirectCrossover() const { return m_directCrossover; }
+    void setGroupSize(size_t bodies) { m_groupSize = std::max<size_t>(bodies, 1); }
+    size_t getGroupSize() const { return m_groupSize; }
+    // Pin the pool's workers to CPUs spread over the NUMA nodes in CpuTopology::detect(), and
+    // place the body and tree arrays on the nodes of the workers that loop over them. Returns
+    // false if the workers could not be pinned, which leaves them floating
+    bool setPinWorkers(bool enabled);
+    bool getPinWorkers() const { return m_pinWorkers; }
+    // Split the Barnes-Hut force loop by last step's walk costs instead of handing out guided chunks
+    void setCostBalancing(bool enabled) { m_costBalancing = enabled; }
+    bool getCostBalancing() const { return m_costBalancing; }
+    void setParallelPropagate(bool enabled) { m_parallelPropagate = enabled; }
+    bool getParallelPropagate() const { return m_parallelPropagate; }
+    void setRefitThreshold(double fraction) { m_refitThreshold = fraction; }
+    double getRefitThreshold() const { return m_refitThreshold; }
+    void setBodyOrdering(BodyOrdering ordering) { m_bodyOrdering = ordering; }
+    BodyOrdering getBodyOrdering() const { return m_bodyOrdering; }
+    void setReorderInterval(int steps) { m_reorderInterval = std::max(steps, 0); }
+    int getReorderInterval() const { return m_reorderInterval; }
+    void setReorderThreshold(double scatter) { m_reorderThreshold = scatter; }
+    double getReorderThreshold() const { return m_reorderThreshold; }
+    double getScatter() const { return m_scatter; }
+    void setLeafCapacity(size_t capacity) { m_quadtree.setLeafCapacity(capacity); }
+    size_t getLeafCapacity() const { return m_quadtree.getLeafCapacity(); }
+    void setQuadrupole(bool enabled) { m_quadtree.setQuadrupole(enabled); }
+    bool getQuadrupole() const { return m_quadtree.getQuadrupole(); }
+    void setOpeningCriterion(OpeningCriterion criterion) { m_quadtree.setOpeningCriterion(criterion); }
+    OpeningCriterion getOpeningCriterion() const { return m_quadtree.getOpeningCriterion(); }
+    void setMixedPrecision(bool enabled) { m_quadtree.setMixedPrecision(enabled); }
+    bool getMixedPrecision() const { return m_quadtree.getMixedPrecision(); }
+    // Reuse group interaction lists across steps, see Quadtree::setListSkin. Needs GroupWalk and Refit
+    void setListSkin(double skin) { m_quadtree.setListSkin(skin); }
+    double getListSkin() const { return m_quadtree.getListSkin(); }
+    const BodyStore& getBodies() const { return m_bodies; }
     void toggleWF() { m_toggleWF = !m_toggleWF; }
     Quadtree& getQuadtree() { return m_quadtree; }
 };
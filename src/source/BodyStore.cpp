@@ -0,0 +1,192 @@
+#include "../headers/BodyStore.h"
+#include "../utils/BatchMath.h"
+#include <algorithm>
+#include <functional>
+
+void BodyStore::clear()
+{
+    for (uint32_t id : m_id) {
+        freeSlot(id);
+    }
+    // Hand out the lowest slots first again, so slot order follows insertion order
+    std::sort(m_freeSlots.begin(), m_freeSlots.end(), std::greater<uint32_t>());
+
+    m_x.clear();
+    m_y.clear();
+    m_vx.clear();
+    m_vy.clear();
+    m_ax.clear();
+    m_ay.clear();
+    m_mass.clear();
+    m_radius.clear();
+    m_color.clear();
+    m_id.clear();
+}
+
+void BodyStore::reserve(size_t count)
+{
+    m_x.reserve(count);
+    m_y.reserve(count);
+    m_vx.reserve(count);
+    m_vy.reserve(count);
+    m_ax.reserve(count);
+    m_ay.reserve(count);
+    m_mass.reserve(count);
+    m_radius.reserve(count);
+    m_color.reserve(count);
+    m_id.reserve(count);
+}
+
+uint32_t BodyStore::insert(const Body& body)
+{
+    uint32_t slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else if (m_slotIndex.size() < MAX_BODIES) {
+        slot = static_cast<uint32_t>(m_slotIndex.size());
+        m_slotIndex.push_back(0);
+        m_slotGeneration.push_back(0);
+    } else {
+        return NO_BODY_ID;
+    }
+
+    uint32_t id = (m_slotGeneration[slot] << SLOT_BITS) | slot;
+    m_slotIndex[slot] = static_cast<uint32_t>(size());
+
+    m_x.push_back(body.getPos().getX());
+    m_y.push_back(body.getPos().getY());
+    m_vx.push_back(body.getVel().getX());
+    m_vy.push_back(body.getVel().getY());
+    m_ax.push_back(body.getAcc().getX());
+    m_ay.push_back(body.getAcc().getY());
+    m_mass.push_back(body.getMass());
+    m_radius.push_back(body.getRadius());
+    m_color.push_back(body.getColor());
+    m_id.push_back(id);
+    return id;
+}
+
+void BodyStore::freeSlot(uint32_t id)
+{
+    uint32_t slot = id & MAX_BODIES;
+    // Generations wrap within the bits left over by the slot
+    m_slotGeneration[slot] = (m_slotGeneration[slot] + 1) & ((1u << (32 - SLOT_BITS)) - 1);
+    m_freeSlots.push_back(slot);
+}
+
+void BodyStore::remove(size_t i)
+{
+    freeSlot(m_id[i]);
+
+    // Move the last body into the gap, its id now points here
+    size_t last = size() - 1;
+    if (i != last) {
+        m_x[i] = m_x[last];
+        m_y[i] = m_y[last];
+        m_vx[i] = m_vx[last];
+        m_vy[i] = m_vy[last];
+        m_ax[i] = m_ax[last];
+        m_ay[i] = m_ay[last];
+        m_mass[i] = m_mass[last];
+        m_radius[i] = m_radius[last];
+        m_color[i] = m_color[last];
+        m_id[i] = m_id[last];
+        m_slotIndex[m_id[i] & MAX_BODIES] = static_cast<uint32_t>(i);
+    }
+
+    m_x.pop_back();
+    m_y.pop_back();
+    m_vx.pop_back();
+    m_vy.pop_back();
+    m_ax.pop_back();
+    m_ay.pop_back();
+    m_mass.pop_back();
+    m_radius.pop_back();
+    m_color.pop_back();
+    m_id.pop_back();
+}
+
+size_t BodyStore::indexOf(uint32_t id) const
+{
+    uint32_t slot = id & MAX_BODIES;
+    if (id == NO_BODY_ID || slot >= m_slotIndex.size()) return NOT_FOUND;
+
+    // A freed slot has a newer generation, and may hold a newer body
+    size_t index = m_slotIndex[slot];
+    if (index >= size() || m_id[index] != id) return NOT_FOUND;
+    return index;
+}
+
+Body BodyStore::get(size_t i) const
+{
+    Body body(m_mass[i], m_radius[i], Vec2(m_x[i], m_y[i]), Vec2(m_vx[i], m_vy[i]), m_color[i]);
+    body.setAcc(Vec2(m_ax[i], m_ay[i]));
+    body.m_id = m_id[i];
+    return body;
+}
+
+// One field at a time, so each pass streams two arrays instead of every field at once
+template <typename T>
+static void permuteField(FieldVector<T>& field, const std::vector<uint32_t>& index, FieldVector<T>& scratch)
+{
+    scratch.resize(index.size());
+    for (size_t i = 0; i < index.size(); ++i) {
+        scratch[i] = field[index[i]];
+    }
+    field.swap(scratch);
+}
+
+void BodyStore::permute(const std::vector<uint32_t>& index)
+{
+    permuteField(m_x, index, m_scratch);
+    permuteField(m_y, index, m_scratch);
+    permuteField(m_vx, index, m_scratch);
+    permuteField(m_vy, index, m_scratch);
+    permuteField(m_ax, index, m_scratch);
+    permuteField(m_ay, index, m_scratch);
+    permuteField(m_mass, index, m_scratch);
+    permuteField(m_radius, index, m_scratch);
+
+    permuteField(m_color, index, m_colorScratch);
+    permuteField(m_id, index, m_idScratch);
+
+    for (size_t i = 0; i < m_id.size(); ++i) {
+        m_slotIndex[m_id[i] & MAX_BODIES] = static_cast<uint32_t>(i);
+    }
+}
+
+void BodyStore::placeOnWorkers(ThreadPool& pool, size_t grain)
+{
+    for (FieldVector<double>* field : {&m_x, &m_y, &m_vx, &m_vy, &m_ax, &m_ay, &m_mass, &m_radius}) {
+        ::placeOnWorkers(*field, pool, grain);
+    }
+    ::placeOnWorkers(m_color, pool, grain);
+    ::placeOnWorkers(m_id, pool, grain);
+
+    // After a permute() the fields live in what is now scratch
+    m_scratch.resize(size());
+    m_colorScratch.resize(size());
+    m_idScratch.resize(size());
+    ::placeOnWorkers(m_scratch, pool, grain);
+    ::placeOnWorkers(m_colorScratch, pool, grain);
+    ::placeOnWorkers(m_idScratch, pool, grain);
+}
+
+void BodyStore::kick(years_t dt, size_t first, size_t last)
+{
+    axpy(last - first, dt.count(), m_ax.data() + first, m_vx.data() + first);
+    axpy(last - first, dt.count(), m_ay.data() + first, m_vy.data() + first);
+}
+
+void BodyStore::drift(years_t dt, size_t first, size_t last)
+{
+    axpy(last - first, dt.count(), m_vx.data() + first, m_x.data() + first);
+    axpy(last - first, dt.count(), m_vy.data() + first, m_y.data() + first);
+}
+
+void BodyStore::kickDrift(years_t kickDt, years_t driftDt, size_t first, size_t last, Bounds& bounds)
+{
+    ::kickDrift(last - first, kickDt.count(), driftDt.count(), m_ax.data() + first, m_ay.data() + first,
+                m_vx.data() + first, m_vy.data() + first, m_x.data() + first, m_y.data() + first, bounds);
+}
@@ -37,10 +37,10 @@ void InputHandler::handleSelection(Sidebar &sidebar, Simulation &sim, const Came
         // Raycast / Hit Test
         Vec2 simPos(mouseWorld.x, mouseWorld.y);
         
-        Body* clickedBody = sim.getBodyAt(simPos);
+        std::optional<BodyRef> clickedBody = sim.getBodyAt(simPos);
 
         if (clickedBody) {
-            sidebar.selectBody(clickedBody);
+            sidebar.selectBody(clickedBody->getId());
         } else {
             // Clicked empty space
             sidebar.deselect();
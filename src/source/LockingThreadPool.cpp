@@ -0,0 +1,84 @@
+#include "../headers/LockingThreadPool.h"
+
+LockingThreadPool::LockingThreadPool(size_t numThreads) 
+    : m_tasks(64), m_stop(false), m_activeTasks(0), m_queuedTasks(0)
+{
+    // Create worker threads that will process tasks
+    for (size_t i = 0; i < numThreads; ++i) {
+        m_workers.emplace_back([this] {
+            while (true) {
+                Task task;
+                
+                {
+                    std::unique_lock<std::mutex> lock(m_queueMutex);
+                    
+                    // Wait for a task or stop signal
+                    m_condition.wait(lock, [this] {
+                        return m_stop || m_queuedTasks > 0;
+                    });
+                    
+                    // Exit if we're stopping and no tasks left
+                    if (m_stop && m_queuedTasks == 0) {
+                        return;
+                    }
+                    
+                    // Get task from queue
+                    task = m_tasks[m_head];
+                    m_head = (m_head + 1) % m_tasks.size();
+                    --m_queuedTasks;
+                    ++m_activeTasks;
+                }
+                
+                // Execute the task (outside the lock)
+                task.run(task.storage);
+                
+                // Mark task as complete
+                {
+                    std::lock_guard<std::mutex> lock(m_queueMutex);
+                    --m_activeTasks;
+                }
+                m_waitCondition.notify_all();
+            }
+        });
+    }
+}
+
+LockingThreadPool::~LockingThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    
+    for (std::thread& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void LockingThreadPool::push(const Task& task) {
+    {
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        size_t queued = m_queuedTasks;
+        if (queued == m_tasks.size()) {
+            // Full, unroll the ring into a buffer twice the size
+            std::vector<Task> grown(2 * m_tasks.size());
+            for (size_t i = 0; i < queued; ++i) {
+                grown[i] = m_tasks[(m_head + i) % m_tasks.size()];
+            }
+            m_tasks.swap(grown);
+            m_head = 0;
+        }
+        m_tasks[(m_head + queued) % m_tasks.size()] = task;
+        ++m_queuedTasks;
+    }
+    m_condition.notify_one();
+}
+
+void LockingThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_waitCondition.wait(lock, [this] {
+        return m_queuedTasks == 0 && m_activeTasks == 0;
+    });
+}
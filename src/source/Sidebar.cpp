@@ -57,16 +57,17 @@ void Sidebar::render() {
         DrawLine(10, 45, bounds_.width - 10, 45, LIGHTGRAY);
 
         if (currentTab_ == SidebarTab::INSPECTOR) {
-            if (selectedBody_ != nullptr) {
+            std::optional<BodyRef> selectedBody = simulation_.findBody(selectedId_);
+            if (selectedBody) {
                 GuiLabel((Rectangle){ 10, 50, 200, 20 }, "Body Properties");
                 
                 // Position Readout
-                GuiLabel((Rectangle){ 10, 70, 200, 20 }, TextFormat("Pos: %.2f, %.2f AU", selectedBody_->getPos().getX(), selectedBody_->getPos().getY()));
+                GuiLabel((Rectangle){ 10, 70, 200, 20 }, TextFormat("Pos: %.2f, %.2f AU", selectedBody->getPos().getX(), selectedBody->getPos().getY()));
 
                 // --- MASS (Log Scale) ---
                 GuiLabel((Rectangle){ 10, 100, 200, 20 }, "Mass (Log Scale)");
                 
-                double currentMass = selectedBody_->getMass();
+                double currentMass = selectedBody->getMass();
                 float oldLogMass = (float)log10(currentMass); 
                 float logMass = oldLogMass;
                 
@@ -74,21 +75,21 @@ void Sidebar::render() {
                 GuiSlider((Rectangle){ 60, 120, 150, 20 }, "Mass", TextFormat("%.2e", currentMass), &logMass, -8.0f, 1.0f);
                 
                 if (logMass != oldLogMass) {
-                    selectedBody_->setMass(pow(10.0, logMass));
+                    selectedBody->setMass(pow(10.0, logMass));
                     
                     // Optional: Auto-scale radius in Inspector too?
                     // This keeps it consistent with the Creator tab behavior
                     double newRadius = 0.02 + 0.005 * (logMass + 8.0);
-                    selectedBody_->setRadius(newRadius);
+                    selectedBody->setRadius(newRadius);
                 }
 
                 // --- RADIUS (Read Only / Auto) ---
                 GuiLabel((Rectangle){ 10, 150, 200, 20 }, "Radius (Auto-Scaled)");
-                GuiStatusBar((Rectangle){ 60, 170, 150, 20 }, TextFormat("%.4f AU", selectedBody_->getRadius()));
+                GuiStatusBar((Rectangle){ 60, 170, 150, 20 }, TextFormat("%.4f AU", selectedBody->getRadius()));
 
                 // --- VELOCITY (Direct Control) ---
                 // 1. Get local copy
-                Vec2 currentVel = selectedBody_->getVel();
+                Vec2 currentVel = selectedBody->getVel();
 
                 GuiLabel((Rectangle){ 10, 200, 200, 20 }, "Velocity X (AU/yr)");
                 float tempVelX = (float)currentVel.getX();
@@ -101,12 +102,12 @@ void Sidebar::render() {
                 currentVel.setY(tempVelY);
 
                 // 2. Write back to real body
-                selectedBody_->setVel(currentVel);
+                selectedBody->setVel(currentVel);
 
                 // --- DELETE BUTTON ---
                 // Moved down slightly to make room for velocity controls
                 if (GuiButton((Rectangle){ 10, 320, availableWidth, 40 }, "DELETE BODY")) {
-                    simulation_.DeleteBodyAt( selectedBody_->getPos() );
+                    simulation_.removeBody( selectedId_ );
                     deselect();
                 }
             } else {
@@ -300,7 +301,7 @@ void Sidebar::render() {
             // Create Button
             if (GuiButton((Rectangle){ 10, 320, 220, 40 }, "SPAWN BODY")) {
                 Body newBody( tempBody_ );
-                selectedBody_ = simulation_.addBody( newBody );                
+                selectedId_ = simulation_.addBody( newBody );                
                 currentTab_ = SidebarTab::INSPECTOR;
                 timeManager_.togglePause(); // Unpause on creation
             }
@@ -325,16 +326,20 @@ void Sidebar::openCreationMenu(Vec2 worldPos) {
     tempBody_.setVel(Vec2(0.0, 0.0));
 }
 
-void Sidebar::selectBody(Body* body) {
-    selectedBody_ = body;
+void Sidebar::selectBody(uint32_t id) {
+    selectedId_ = id;
     isOpen_ = true; // Auto open on click
 }
 
 void Sidebar::deselect() {
-    selectedBody_ = nullptr;
+    selectedId_ = NO_BODY_ID;
     isOpen_ = false;
 }
 
+bool Sidebar::hasSelection() const {
+    return simulation_.findBody(selectedId_).has_value();
+}
+
 bool Sidebar::isMouseOver() {
     Vector2 mouse = GetMousePosition();
     return CheckCollisionPointRec(mouse, bounds_);
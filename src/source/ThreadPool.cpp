@@ -1,55 +1,74 @@
 #include "../headers/ThreadPool.h"
+#include "../utils/Topology.h"
+#include <cstring>
 
-ThreadPool::ThreadPool(size_t numThreads) 
-    : m_stop(false), m_activeTasks(0), m_queuedTasks(0)
+// Failed attempts to find work before an idle worker goes to sleep. Steps submit several
+// rounds of tasks back to back, which should find the workers still awake
+static constexpr int SPIN_ROUNDS = 1024;
+
+bool ThreadPool::WorkerQueue::tryPush(const Task& task) {
+    uint64_t b = bottom.load(std::memory_order_relaxed);
+    if (b - top.load(std::memory_order_acquire) >= CAPACITY) {
+        return false;
+    }
+
+    uint64_t words[TASK_WORDS];
+    std::memcpy(words, &task, sizeof(Task));
+    std::atomic<uint64_t>* slot = slots[b % CAPACITY];
+    for (size_t w = 0; w < TASK_WORDS; ++w) {
+        slot[w].store(words[w], std::memory_order_relaxed);
+    }
+
+    // Sequentially consistent, so a worker about to sleep either sees the task or is seen by push()
+    bottom.store(b + 1, std::memory_order_seq_cst);
+    return true;
+}
+
+bool ThreadPool::WorkerQueue::tryTake(Task& task) {
+    uint64_t t = top.load(std::memory_order_acquire);
+    while (true) {
+        if (t >= bottom.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        uint64_t words[TASK_WORDS];
+        const std::atomic<uint64_t>* slot = slots[t % CAPACITY];
+        for (size_t w = 0; w < TASK_WORDS; ++w) {
+            words[w] = slot[w].load(std::memory_order_relaxed);
+        }
+
+        // The slot can only have been refilled once another thread took task t, so if the
+        // exchange succeeds the copy is intact
+        if (top.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            std::memcpy(&task, words, sizeof(Task));
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::WorkerQueue::hasWork() const {
+    return top.load(std::memory_order_seq_cst) < bottom.load(std::memory_order_seq_cst);
+}
+
+ThreadPool::ThreadPool(size_t numThreads)
+    : m_queues(new WorkerQueue[numThreads > 0 ? numThreads : 1]),
+      m_queueCount(numThreads > 0 ? numThreads : 1),
+      m_affinity(new WorkerAffinity[numThreads > 0 ? numThreads : 1])
 {
     // Create worker threads that will process tasks
     for (size_t i = 0; i < numThreads; ++i) {
-        m_workers.emplace_back([this] {
-            while (true) {
-                std::function<void()> task;
-                
-                {
-                    std::unique_lock<std::mutex> lock(m_queueMutex);
-                    
-                    // Wait for a task or stop signal
-                    m_condition.wait(lock, [this] {
-                        return m_stop || !m_tasks.empty();
-                    });
-                    
-                    // Exit if we're stopping and no tasks left
-                    if (m_stop && m_tasks.empty()) {
-                        return;
-                    }
-                    
-                    // Get task from queue
-                    task = std::move(m_tasks.front());
-                    m_tasks.pop();
-                    --m_queuedTasks;
-                    ++m_activeTasks;
-                }
-                
-                // Execute the task (outside the lock)
-                task();
-                
-                // Mark task as complete
-                {
-                    std::lock_guard<std::mutex> lock(m_queueMutex);
-                    --m_activeTasks;
-                }
-                m_waitCondition.notify_all();
-            }
-        });
+        m_workers.emplace_back([this, i] { workerLoop(i); });
     }
 }
 
 ThreadPool::~ThreadPool() {
+    wait();
     {
-        std::lock_guard<std::mutex> lock(m_queueMutex);
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
         m_stop = true;
     }
-    m_condition.notify_all();
-    
+    m_sleepCondition.notify_all();
+
     for (std::thread& worker : m_workers) {
         if (worker.joinable()) {
             worker.join();
@@ -57,18 +76,131 @@ ThreadPool::~ThreadPool() {
     }
 }
 
-void ThreadPool::enqueue(std::function<void()> task) {
-    {
-        std::unique_lock<std::mutex> lock(m_queueMutex);
-        m_tasks.push(std::move(task));
-        ++m_queuedTasks;
+bool ThreadPool::hasWork() const {
+    for (size_t q = 0; q < m_queueCount; ++q) {
+        if (m_queues[q].hasWork()) return true;
+    }
+    return false;
+}
+
+bool ThreadPool::runOne(size_t first) {
+    Task task;
+    for (size_t k = 0; k < m_queueCount; ++k) {
+        if (m_queues[(first + k) % m_queueCount].tryTake(task)) {
+            task.run(task.storage);
+            m_pending.fetch_sub(1, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::affinityChanged(size_t index) const {
+    return m_affinity[index].applied.load(std::memory_order_relaxed) != m_affinityVersion.load(std::memory_order_acquire);
+}
+
+void ThreadPool::applyAffinity(size_t index) {
+    uint32_t version = m_affinityVersion.load(std::memory_order_acquire);
+    WorkerAffinity& affinity = m_affinity[index];
+    if (affinity.applied.load(std::memory_order_relaxed) == version) return;
+
+    int cpu = affinity.cpu.load(std::memory_order_relaxed);
+    affinity.failed.store(!pinCurrentThread(cpu), std::memory_order_relaxed);
+    affinity.applied.store(version, std::memory_order_release);
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    int idle = 0;
+    while (true) {
+        applyAffinity(index);
+        if (runOne(index)) {
+            idle = 0;
+            continue;
+        }
+        if (m_stop.load(std::memory_order_acquire)) {
+            return;
+        }
+        if (++idle < SPIN_ROUNDS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Out of work for a while, sleep until push() or the destructor wakes us
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+        m_sleepCondition.wait(lock, [this, index] {
+            return m_stop.load(std::memory_order_acquire) || hasWork() || affinityChanged(index);
+        });
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+void ThreadPool::push(const Task& task, size_t queue) {
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+
+    while (m_submitLock.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    if (queue == ANY_QUEUE) {
+        queue = m_nextQueue;
+        m_nextQueue = (m_nextQueue + 1) % m_queueCount;
+    }
+    bool queued = false;
+    for (size_t k = 0; k < m_queueCount && !queued; ++k) {
+        queued = m_queues[(queue + k) % m_queueCount].tryPush(task);
+    }
+    m_submitLock.clear(std::memory_order_release);
+
+    if (!queued) {
+        // Every queue is full, run it here rather than wait for room
+        Task local = task;
+        local.run(local.storage);
+        m_pending.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+
+    if (m_sleepers.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_sleepCondition.notify_one();
     }
-    m_condition.notify_one();
 }
 
 void ThreadPool::wait() {
-    std::unique_lock<std::mutex> lock(m_queueMutex);
-    m_waitCondition.wait(lock, [this] {
-        return m_queuedTasks == 0 && m_activeTasks == 0;
-    });
+    // Help out instead of blocking, the last tasks of a round are often still queued
+    bool help = !m_pinned.load(std::memory_order_relaxed);
+    int idle = 0;
+    while (m_pending.load(std::memory_order_acquire) != 0) {
+        if (help && runOne(m_queueCount - 1)) {
+            idle = 0;
+        } else if (++idle > 64) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ThreadPool::setAffinity(const std::vector<int>& cpus) {
+    if (m_workers.empty()) return cpus.empty();
+
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        m_affinity[i].cpu.store(cpus.empty() ? -1 : cpus[i % cpus.size()], std::memory_order_relaxed);
+    }
+
+    // Bumped under the sleep mutex, so a worker about to sleep either sees it or is woken
+    uint32_t version;
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        version = m_affinityVersion.fetch_add(1, std::memory_order_release) + 1;
+    }
+    m_sleepCondition.notify_all();
+
+    bool pinned = true;
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        while (m_affinity[i].applied.load(std::memory_order_acquire) != version) {
+            std::this_thread::yield();
+        }
+        pinned = pinned && !m_affinity[i].failed.load(std::memory_order_relaxed);
+    }
+    m_pinned.store(!cpus.empty() && pinned, std::memory_order_relaxed);
+    return pinned;
 }
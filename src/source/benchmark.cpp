@@ -3,12 +3,123 @@
 #include <fstream>
 #include <chrono>
 #include <string>
+#include <thread>
+#include <algorithm>
+#include <cmath>
 #include "../headers/simulation.h"
+#include "../headers/LockingThreadPool.h"
+#include "../utils/AllocationCounter.h"
+#include "../utils/ParticleSystem.h"
 
-void benchmark::runHeadlessBenchmark(int numBodies, double theta, int totalTicks, years_t fixedDeltaT, std::ofstream& csv) {
-    std::cout << "[BENCHMARK] Testing N=" << numBodies << " | Theta=" << theta << "...\n";
+static const char* CSV_HEADER = "N,Theta,AvgTotalMs,AvgTreeMs,AvgForceMs,AvgCollMs,InitialTotalEnergy,FinalTotalEnergy,RelEnergyDrift,ForceRmsError,Builder,LeafCapacity,Quadrupole,Solver,GroupSize,Kernel,MixedPrecision,Ordering,ReorderInterval,DirectCrossover,Criterion,AvgInteractions,ListSkin,ListReuseRate,Collisions,SteadyAllocsPerStep,CostBalancing,ForceImbalance,PinWorkers\n";
+
+// Readable name for the builder column of the CSV
+static const char* builderName(TreeBuilder builder) {
+    switch (builder) {
+        case TreeBuilder::Morton: return "Morton";
+        case TreeBuilder::Parallel: return "Parallel";
+        case TreeBuilder::Refit: return "Refit";
+        default: return "Insertion";
+    }
+}
+
+// Readable name for the solver column of the CSV
+static const char* solverName(ForceSolver solver) {
+    switch (solver) {
+        case ForceSolver::Fmm: return "FMM";
+        case ForceSolver::GroupWalk: return "GroupWalk";
+        case ForceSolver::Direct: return "Direct";
+        default: return "BarnesHut";
+    }
+}
+
+// Readable name for the ordering column of the CSV
+static const char* orderingName(BodyOrdering ordering) {
+    switch (ordering) {
+        case BodyOrdering::Morton: return "Morton";
+        case BodyOrdering::Hilbert: return "Hilbert";
+        default: return "None";
+    }
+}
+
+// Readable name for the criterion column of the CSV
+static const char* criterionName(OpeningCriterion criterion) {
+    switch (criterion) {
+        case OpeningCriterion::Bmax: return "Bmax";
+        case OpeningCriterion::RelativeAccuracy: return "RelativeAccuracy";
+        default: return "Geometric";
+    }
+}
+
+// Average number of interactions each body was summed against in the last step: the group
+// lists for GroupWalk, otherwise a per-body walk of the final tree on an evenly spaced sample
+// of bodies. 0 when the last step did not use a tree walk
+static double averageInteractions(Simulation& sim, size_t samples) {
+    ForceSolver solver = sim.getActiveForceSolver();
+    const BodyStore& bodies = sim.getBodies();
+    if (bodies.empty() || (solver != ForceSolver::BarnesHut && solver != ForceSolver::GroupWalk)) return 0.0;
+
+    // Group walks sum each body against its group's list, not against its own walk
+    if (solver == ForceSolver::GroupWalk && sim.getQuadtree().getGroupCount() > 0) {
+        return sim.getQuadtree().getGroupInteractionsPerBody();
+    }
+
+    InteractionList list;
+    size_t stride = std::max<size_t>(1, bodies.size() / samples);
+    double total = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < bodies.size(); i += stride) {
+        sim.getQuadtree().acc(bodies[i].getPos(), list, std::sqrt(bodies[i].getAcc().magSqrd()));
+        total += static_cast<double>(list.count + list.farCount);
+        count++;
+    }
+    return total / count;
+}
+
+// RMS relative error of the accelerations from the last update against direct summation,
+// measured on an evenly spaced sample of bodies
+static double forceRmsError(const BodyStore& bodies, size_t samples) {
+    if (bodies.empty()) return 0.0;
+
+    DirectSum exact(SOFTENING);
+    exact.load(bodies);
+
+    size_t stride = std::max<size_t>(1, bodies.size() / samples);
+    double sum = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < bodies.size(); i += stride) {
+        Vec2 reference = exact.accAt(bodies[i].getPos());
+        double refSq = reference.magSqrd();
+        if (refSq == 0.0) continue;
+        sum += (bodies[i].getAcc() - reference).magSqrd() / refSq;
+        count++;
+    }
+    return count > 0 ? std::sqrt(sum / count) : 0.0;
+}
+
+void benchmark::runHeadlessBenchmark(int numBodies, double theta, int totalTicks, years_t fixedDeltaT, std::ofstream& csv, const Options& options) {
+    std::cout << "[BENCHMARK] Testing N=" << numBodies << " | Theta=" << theta
+              << " | Builder=" << builderName(options.builder) << " | k=" << options.leafCapacity
+              << " | Quadrupole=" << options.quadrupole << " | Solver=" << solverName(options.solver)
+              << " | Kernel=" << forceIsaName(options.forceIsa) << " | Mixed=" << options.mixedPrecision
+              << " | Ordering=" << orderingName(options.ordering)
+              << " | Criterion=" << criterionName(options.criterion) << "...\n";
 
     Simulation sim(theta);
+    sim.setTreeBuilder(options.builder);
+    sim.setLeafCapacity(options.leafCapacity);
+    sim.setQuadrupole(options.quadrupole);
+    sim.setForceSolver(options.solver);
+    sim.setGroupSize(options.groupSize);
+    setForceIsa(options.forceIsa);
+    sim.setMixedPrecision(options.mixedPrecision);
+    sim.setBodyOrdering(options.ordering);
+    sim.setReorderInterval(options.reorderInterval);
+    sim.setDirectCrossover(options.directCrossover);
+    sim.setOpeningCriterion(options.criterion);
+    sim.setListSkin(options.listSkin);
+    sim.setCostBalancing(options.costBalancing);
+    bool pinned = options.pinWorkers && sim.setPinWorkers(true);
     std::string filename = "master_benchmark_N_" + std::to_string(numBodies) + ".sim";
     sim.loadSimulation(filename); 
     
@@ -18,29 +129,48 @@ void benchmark::runHeadlessBenchmark(int numBodies, double theta, int totalTicks
     double totalTreeTime = 0.0;
     double totalForceTime = 0.0;
     double totalCollTime = 0.0;
+    double totalReuseRate = 0.0;
+    double totalImbalance = 0.0;
+
+    // Buffers and arenas grow during the first steps, heap allocations are counted after those
+    int warmupTicks = std::min(10, totalTicks / 2);
+    size_t warmupAllocations = 0;
 
     auto start = std::chrono::high_resolution_clock::now();
 
     for (int i = 0; i < totalTicks; i++) {
-        sim.update(fixedDeltaT, true); 
+        if (i == warmupTicks) warmupAllocations = allocationCount();
+        sim.update(fixedDeltaT, options.collisions); 
         
         // Accumulate specific subsystem times
-        // totalTreeTime += sim.getLastTreeBuildTimeMs();
-        // totalForceTime += sim.getLastForceCalcTimeMs();
-        // totalCollTime += sim.getLastCollisionTimeMs();
+        totalTreeTime += sim.getLastTreeBuildTimeMs();
+        totalForceTime += sim.getLastForceCalcTimeMs();
+        totalCollTime += sim.getLastCollisionTimeMs();
+        totalReuseRate += sim.getQuadtree().getListReuseRate();
+        totalImbalance += sim.getForceImbalance();
     }
 
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    size_t steadyAllocations = allocationCount() - warmupAllocations;
 
     // Calculate Averages
     double avgTotalMs = static_cast<double>(duration.count()) / totalTicks;
     double avgTreeMs = totalTreeTime / totalTicks;
     double avgForceMs = totalForceTime / totalTicks;
     double avgCollMs = totalCollTime / totalTicks;
+    double avgReuseRate = totalReuseRate / totalTicks;
+    double avgImbalance = totalImbalance / totalTicks;
+    double allocsPerStep = totalTicks > warmupTicks ? static_cast<double>(steadyAllocations) / (totalTicks - warmupTicks) : 0.0;
+    if (!countingAllocations()) allocsPerStep = std::nan(""); // Not the benchmark build, nothing was counted
     
     double finalEnergy = sim.calculateTotalEnergy();
 
+    // Positions have not moved since the last force pass, so the stored accelerations still apply
+    double forceError = forceRmsError(sim.getBodies(), 1000);
+    double interactions = averageInteractions(sim, 1000);
+    double energyDrift = initialEnergy != 0.0 ? (finalEnergy - initialEnergy) / std::abs(initialEnergy) : 0.0;
+
     // Write to CSV
     csv << numBodies << "," 
         << theta << "," 
@@ -49,7 +179,224 @@ void benchmark::runHeadlessBenchmark(int numBodies, double theta, int totalTicks
         << avgForceMs << ","
         << avgCollMs << ","
         << initialEnergy << "," 
-        << finalEnergy << "\n";
+        << finalEnergy << ","
+        << energyDrift << ","
+        << forceError << ","
+        << builderName(options.builder) << ","
+        << options.leafCapacity << ","
+        << options.quadrupole << ","
+        << solverName(sim.getActiveForceSolver()) << ","
+        << options.groupSize << ","
+        << forceIsaName(getForceIsa()) << ","
+        << options.mixedPrecision << ","
+        << orderingName(options.ordering) << ","
+        << options.reorderInterval << ","
+        << options.directCrossover << ","
+        << criterionName(options.criterion) << ","
+        << interactions << ","
+        << options.listSkin << ","
+        << avgReuseRate << ","
+        << options.collisions << ","
+        << allocsPerStep << ","
+        << options.costBalancing << ","
+        << avgImbalance << ","
+        << pinned << "\n";
+}
+
+// Times Quadtree::propagate against Quadtree::propagateParallel on the same tree
+void benchmark::runPropagationBenchmark(int numBodies, int repeats, std::ofstream& csv) {
+    std::cout << "[BENCHMARK] Propagation N=" << numBodies << "...\n";
+
+    Simulation sim(0.5);
+    sim.loadPreset(2, numBodies);
+    const BodyStore& bodies = sim.getBodies();
+
+    size_t threadCount = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 4;
+    ThreadPool pool(threadCount);
+
+    Quad boundingQuad = Quad::newContaining(bodies);
+    Quadtree serial(0.5, SOFTENING);
+    Quadtree parallel(0.5, SOFTENING);
+    serial.buildMorton(bodies, boundingQuad);
+    parallel.buildMorton(bodies, boundingQuad);
+
+    double serialMs = 0.0;
+    double parallelMs = 0.0;
+    for (int i = 0; i < repeats; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        serial.propagate();
+        auto mid = std::chrono::high_resolution_clock::now();
+        parallel.propagateParallel(pool, threadCount);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        serialMs += std::chrono::duration<double, std::milli>(mid - start).count();
+        parallelMs += std::chrono::duration<double, std::milli>(end - mid).count();
+    }
+
+    // Largest relative disagreement in mass or center of mass over all nodes
+    const std::vector<Node>& a = serial.getNodes();
+    const std::vector<Node>& b = parallel.getNodes();
+    double maxRelDiff = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].mass == 0.0f) continue;
+        double massDiff = std::abs(a[i].mass - b[i].mass) / a[i].mass;
+        double posDiff = (a[i].getPos() - b[i].getPos()).mag() / std::max(a[i].getPos().mag(), 1e-12);
+        maxRelDiff = std::max(maxRelDiff, std::max(massDiff, posDiff));
+    }
+
+    csv << numBodies << ","
+        << a.size() << ","
+        << serialMs / repeats << ","
+        << parallelMs / repeats << ","
+        << maxRelDiff << "\n";
+}
+
+// Average microseconds of one round: submit `tasks` tasks of `work` loop iterations each, then wait
+template <typename Pool>
+static double timeRounds(Pool& pool, size_t tasks, size_t work, int rounds) {
+    // Each task writes its own cache line, so the tasks themselves do not contend
+    std::vector<double> sinks(tasks * 8, 1.0);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t t = 0; t < tasks; ++t) {
+            double* sink = &sinks[t * 8];
+            pool.enqueue([sink, work]() {
+                double x = *sink;
+                for (size_t i = 0; i < work; ++i) {
+                    x = x * 0.999 + 1.0;
+                }
+                *sink = x;
+            });
+        }
+        pool.wait();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / rounds;
+}
+
+void benchmark::runSchedulerBenchmark(size_t tasks, size_t work, int rounds, std::ofstream& csv) {
+    std::cout << "[BENCHMARK] Scheduler tasks=" << tasks << " work=" << work << "...\n";
+    size_t threadCount = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 4;
+
+    double lockingUs;
+    double stealingUs;
+    {
+        LockingThreadPool pool(threadCount);
+        lockingUs = timeRounds(pool, tasks, work, rounds);
+    }
+    {
+        ThreadPool pool(threadCount);
+        stealingUs = timeRounds(pool, tasks, work, rounds);
+    }
+
+    csv << threadCount << ","
+        << tasks << ","
+        << work << ","
+        << lockingUs << ","
+        << stealingUs << ","
+        << lockingUs / stealingUs << "\n";
+}
+
+template <size_t D>
+static void runDimensionModel(bool cluster, int numBodies, int totalTicks, years_t fixedDeltaT, std::ofstream& csv) {
+    size_t threadCount = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 4;
+    ThreadPool pool(threadCount);
+
+    ParticleSystem<D> system(0.5);
+    if (cluster) {
+        system.generateCluster(numBodies, 42);
+    } else {
+        system.generateDisk(numBodies, 42);
+    }
+    system.computeForces(pool, threadCount);
+    double initialEnergy = system.calculateTotalEnergy();
+
+    double totalTreeTime = 0.0;
+    double totalForceTime = 0.0;
+    double totalCollTime = 0.0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < totalTicks; i++) {
+        system.update(fixedDeltaT, pool, threadCount);
+        totalTreeTime += system.getLastTreeBuildTimeMs();
+        totalForceTime += system.getLastForceCalcTimeMs();
+        totalCollTime += system.getLastCollisionTimeMs();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+    double finalEnergy = system.calculateTotalEnergy();
+    double energyDrift = initialEnergy != 0.0 ? (finalEnergy - initialEnergy) / std::abs(initialEnergy) : 0.0;
+
+    // RMS relative force error on an evenly spaced sample, as forceRmsError does in 2D
+    size_t stride = std::max<size_t>(1, system.size() / 1000);
+    double sum = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < system.size(); i += stride) {
+        Vec<D> reference = system.accAt(system.getPos(i));
+        double refSq = reference.magSqrd();
+        if (refSq == 0.0) continue;
+        sum += (system.getAcc(i) - reference).magSqrd() / refSq;
+        count++;
+    }
+    double forceError = count > 0 ? std::sqrt(sum / count) : 0.0;
+
+    csv << D << ","
+        << (cluster ? "Cluster" : "Disk") << ","
+        << numBodies << ","
+        << totalMs / totalTicks << ","
+        << totalTreeTime / totalTicks << ","
+        << totalForceTime / totalTicks << ","
+        << totalCollTime / totalTicks << ","
+        << system.getTree().nodeCount() << ","
+        << energyDrift << ","
+        << forceError << "\n";
+}
+
+void benchmark::runDimensionBenchmark(int dimensions, bool cluster, int numBodies, int totalTicks, years_t fixedDeltaT, std::ofstream& csv) {
+    std::cout << "[BENCHMARK] " << dimensions << "D " << (cluster ? "cluster" : "disk") << " N=" << numBodies << "...\n";
+    if (dimensions == 3) {
+        runDimensionModel<3>(cluster, numBodies, totalTicks, fixedDeltaT, csv);
+    } else {
+        runDimensionModel<2>(cluster, numBodies, totalTicks, fixedDeltaT, csv);
+    }
+}
+
+// Settings of one runHeadlessBenchmark row, run at every body count of a sweep
+struct SweepConfig {
+    double theta;
+    benchmark::Options options;
+};
+
+// Open a CSV of the benchmark and write its header. Check is_open() before adding rows
+static std::ofstream openCsv(const std::string& path, const char* header) {
+    std::ofstream csv(path);
+    if (!csv.is_open()) {
+        std::cerr << "Failed to open " << path << " for writing!\n";
+        return csv;
+    }
+    csv << header;
+    return csv;
+}
+
+// Write a CSV_HEADER file with one runHeadlessBenchmark row per config and body count.
+// Returns false if the file could not be opened
+static bool runSweep(const std::string& path, const std::vector<SweepConfig>& configs, const std::vector<int>& bodyCounts,
+                     int ticks, years_t fixedDeltaT) {
+    std::ofstream csv = openCsv(path, CSV_HEADER);
+    if (!csv.is_open()) return false;
+
+    for (const SweepConfig& config : configs) {
+        for (int n : bodyCounts) {
+            // Safety valve to prevent O(N^2) lockups on massive clusters
+            if (config.theta == 0.0 && n > 5000) {
+                std::cout << "[BENCHMARK] Skipping N=" << n << " for Theta=0.0 to save time.\n";
+                continue;
+            }
+            // Disks beyond the usual sizes only run a few ticks, a step takes long enough to time
+            benchmark::runHeadlessBenchmark(n, config.theta, n > 10000 ? 50 : ticks, fixedDeltaT, csv, config.options);
+        }
+    }
+    return true;
 }
 
 void benchmark::runAllBenchmarks() {
@@ -74,28 +421,255 @@ void benchmark::runAllBenchmarks() {
 
     // --- PHASE 2: RUN BENCHMARKS ---
     std::cout << "\n--- Phase 2: Executing Benchmark Loops ---\n";
-    
-    std::ofstream csv("SAP_WITHCOLLISIONS.csv");
-    if (!csv.is_open()) {
-        std::cerr << "Failed to open CSV for writing!\n";
-        return;
+
+    std::vector<SweepConfig> thetaRuns;
+    for (double theta : testThetas) {
+        thetaRuns.push_back({theta, Options()});
     }
+    if (!runSweep("SAP_WITHCOLLISIONS.csv", thetaRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
 
-    csv << "N,Theta,AvgTotalMs,AvgTreeMs,AvgForceMs,AvgCollMs,InitialTotalEnergy,FinalTotalEnergy\n";
+    // --- PHASE 3: TREE BUILDER COMPARISON ---
+    std::cout << "\n--- Phase 3: Comparing Tree Builders ---\n";
 
-    for (double theta : testThetas) {
-        std::cout << "\n--- Running series for Theta = " << theta << " ---\n";
-        for (int n : testBodyCounts) {
-            
-            // Safety valve to prevent O(N^2) lockups on massive clusters
-            if (theta == 0.0 && n > 5000) {
-                std::cout << "[BENCHMARK] Skipping N=" << n << " for Theta=0.0 to save time.\n";
-                continue;
+    std::vector<SweepConfig> builderRuns;
+    for (TreeBuilder builder : {TreeBuilder::Insertion, TreeBuilder::Morton, TreeBuilder::Parallel, TreeBuilder::Refit}) {
+        Options options;
+        options.builder = builder;
+        builderRuns.push_back({0.5, options});
+    }
+    if (!runSweep("TREE_BUILDERS.csv", builderRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 4: PROPAGATION ---
+    std::cout << "\n--- Phase 4: Serial vs Level-Parallel Propagation ---\n";
+
+    std::ofstream propagateCsv = openCsv("PROPAGATION.csv", "N,Nodes,SerialMs,ParallelMs,MaxRelDiff\n");
+    if (!propagateCsv.is_open()) return;
+    for (int n : {10000, 100000, 1000000}) {
+        runPropagationBenchmark(n, 20, propagateCsv);
+    }
+    propagateCsv.close();
+
+    // --- PHASE 5: LEAF CAPACITY SWEEP ---
+    std::cout << "\n--- Phase 5: Sweeping Leaf Capacity ---\n";
+
+    std::vector<SweepConfig> leafRuns;
+    for (size_t k : {1, 2, 4, 8, 16, 32, 64}) {
+        Options options;
+        options.builder = TreeBuilder::Parallel;
+        options.leafCapacity = k;
+        leafRuns.push_back({0.5, options});
+    }
+    if (!runSweep("LEAF_CAPACITY.csv", leafRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 6: MONOPOLE VS QUADRUPOLE ---
+    std::cout << "\n--- Phase 6: Monopole vs Quadrupole ---\n";
+
+    std::vector<SweepConfig> multipoleRuns;
+    for (double theta : {0.5, 0.8, 1.0}) {
+        for (bool quadrupole : {false, true}) {
+            Options options;
+            options.quadrupole = quadrupole;
+            multipoleRuns.push_back({theta, options});
+        }
+    }
+    if (!runSweep("MULTIPOLE.csv", multipoleRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 7: BARNES-HUT VS FMM ---
+    std::cout << "\n--- Phase 7: Barnes-Hut vs Fast Multipole ---\n";
+
+    std::vector<SweepConfig> solverRuns;
+    for (ForceSolver solver : {ForceSolver::BarnesHut, ForceSolver::Fmm, ForceSolver::GroupWalk}) {
+        // Bucket leaves keep the FMM's per-node expansion work small
+        Options options;
+        options.builder = TreeBuilder::Parallel;
+        options.leafCapacity = 16;
+        options.solver = solver;
+        solverRuns.push_back({0.5, options});
+    }
+    if (!runSweep("FORCE_SOLVERS.csv", solverRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 8: GROUP SIZE SWEEP ---
+    std::cout << "\n--- Phase 8: Sweeping Group Walk Size ---\n";
+
+    std::vector<SweepConfig> groupRuns;
+    for (size_t groupSize : {8, 16, 32, 64, 128}) {
+        Options options;
+        options.builder = TreeBuilder::Parallel;
+        options.solver = ForceSolver::GroupWalk;
+        options.groupSize = groupSize;
+        groupRuns.push_back({0.5, options});
+    }
+    if (!runSweep("GROUP_SIZE.csv", groupRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 9: FORCE KERNELS ---
+    std::cout << "\n--- Phase 9: Comparing Force Kernels ---\n";
+
+    std::vector<SweepConfig> kernelRuns;
+    for (ForceIsa isa : {ForceIsa::Scalar, ForceIsa::Avx2, ForceIsa::Avx512}) {
+        if (!forceIsaSupported(isa)) {
+            std::cout << "[BENCHMARK] Skipping " << forceIsaName(isa) << ", not supported on this CPU.\n";
+            continue;
+        }
+        for (ForceSolver solver : {ForceSolver::BarnesHut, ForceSolver::GroupWalk}) {
+            Options options;
+            options.builder = TreeBuilder::Parallel;
+            options.solver = solver;
+            options.forceIsa = isa;
+            kernelRuns.push_back({0.5, options});
+        }
+    }
+    bool kernelsWritten = runSweep("FORCE_KERNELS.csv", kernelRuns, testBodyCounts, ticksToRun, fixedDeltaT);
+    setForceIsa(bestForceIsa());
+    if (!kernelsWritten) return;
+
+    // --- PHASE 10: MIXED PRECISION ---
+    std::cout << "\n--- Phase 10: Double vs Mixed Precision Far Field ---\n";
+
+    std::vector<SweepConfig> precisionRuns;
+    for (bool mixed : {false, true}) {
+        for (ForceSolver solver : {ForceSolver::BarnesHut, ForceSolver::GroupWalk}) {
+            Options options;
+            options.builder = TreeBuilder::Parallel;
+            options.solver = solver;
+            options.mixedPrecision = mixed;
+            precisionRuns.push_back({0.5, options});
+        }
+    }
+    if (!runSweep("PRECISION.csv", precisionRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 11: SPATIAL REORDERING ---
+    std::cout << "\n--- Phase 11: Insertion Order vs Reordered Bodies ---\n";
+
+    // Cache misses only dominate once the bodies outgrow the caches, so add a large disk
+    std::vector<int> reorderBodyCounts = testBodyCounts;
+    reorderBodyCounts.push_back(100000);
+    {
+        Simulation masterSim(0.0);
+        masterSim.loadPreset(2, 100000);
+        masterSim.saveSimulation("master_benchmark_N_100000.sim");
+    }
+
+    std::vector<SweepConfig> reorderRuns;
+    for (BodyOrdering ordering : {BodyOrdering::None, BodyOrdering::Morton, BodyOrdering::Hilbert}) {
+        // 0 reorders only when the tree shows the bodies have scattered, 1 reorders every step
+        for (int interval : {0, 1}) {
+            if (ordering == BodyOrdering::None && interval != 0) continue;
+            Options options;
+            options.builder = TreeBuilder::Parallel;
+            options.ordering = ordering;
+            options.reorderInterval = interval;
+            reorderRuns.push_back({0.5, options});
+        }
+    }
+    if (!runSweep("REORDER.csv", reorderRuns, reorderBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 12: DIRECT SUMMATION CROSSOVER ---
+    std::cout << "\n--- Phase 12: Tree Solvers vs Direct Summation ---\n";
+
+    std::vector<SweepConfig> directRuns;
+    for (ForceSolver solver : {ForceSolver::BarnesHut, ForceSolver::GroupWalk, ForceSolver::Direct}) {
+        Options options;
+        options.builder = TreeBuilder::Parallel;
+        options.solver = solver;
+        directRuns.push_back({0.5, options});
+    }
+    if (!runSweep("DIRECT.csv", directRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 13: OPENING CRITERIA ---
+    std::cout << "\n--- Phase 13: Comparing Opening Criteria ---\n";
+
+    // Error against AvgInteractions across thetas shows which criterion reaches an accuracy cheapest.
+    // RelativeAccuracy's tolerance is fitted to Geometric's error, so on the disk presets rows with
+    // the same theta compare the criteria at about the same ForceRmsError
+    std::vector<SweepConfig> criteriaRuns;
+    for (OpeningCriterion criterion : {OpeningCriterion::Geometric, OpeningCriterion::Bmax, OpeningCriterion::RelativeAccuracy}) {
+        for (double theta : {0.2, 0.3, 0.5, 0.7, 1.0}) {
+            Options options;
+            options.builder = TreeBuilder::Parallel;
+            options.criterion = criterion;
+            criteriaRuns.push_back({theta, options});
+        }
+    }
+    if (!runSweep("CRITERIA.csv", criteriaRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 14: INTERACTION LIST REUSE ---
+    std::cout << "\n--- Phase 14: Reusing Group Interaction Lists ---\n";
+
+    // Lists survive only while refit keeps the topology; a wider skin reuses more often but
+    // walks a larger box, so each list holds more interactions. Collision corrections push more
+    // bodies out of their leaves than refit accepts, so collisions are off to measure reuse itself
+    std::vector<SweepConfig> reuseRuns;
+    for (double skin : {0.0, 0.05, 0.1, 0.2}) {
+        Options options;
+        options.builder = TreeBuilder::Refit;
+        options.solver = ForceSolver::GroupWalk;
+        options.listSkin = skin;
+        options.collisions = false;
+        reuseRuns.push_back({0.5, options});
+    }
+    if (!runSweep("REUSE.csv", reuseRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 15: 2D VS 3D ---
+    std::cout << "\n--- Phase 15: 2D vs 3D Models ---\n";
+
+    // The same disk and cluster models generated in 2D and 3D, stepped by ParticleSystem
+    std::ofstream dimensionCsv = openCsv("DIMENSIONS.csv", "Dimensions,Model,N,AvgTotalMs,AvgTreeMs,AvgForceMs,AvgCollMs,Nodes,RelEnergyDrift,ForceRmsError\n");
+    if (!dimensionCsv.is_open()) return;
+    for (bool cluster : {false, true}) {
+        for (int dimensions : {2, 3}) {
+            for (int n : testBodyCounts) {
+                runDimensionBenchmark(dimensions, cluster, n, ticksToRun, fixedDeltaT, dimensionCsv);
             }
-            runHeadlessBenchmark(n, theta, ticksToRun, fixedDeltaT, csv);
         }
     }
+    dimensionCsv.close();
+
+    // --- PHASE 16: SCHEDULERS ---
+    std::cout << "\n--- Phase 16: Locking vs Work-Stealing Pool ---\n";
+
+    // Empty tasks measure pure submit and wake-up overhead, the others a step's chunked
+    // phases with small and mid N per task
+    std::ofstream schedulerCsv = openCsv("SCHEDULER.csv", "Threads,Tasks,WorkPerTask,LockingUs,StealingUs,Speedup\n");
+    if (!schedulerCsv.is_open()) return;
+    size_t threadCount = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 4;
+    for (size_t tasks : {threadCount, 4 * threadCount, size_t(64)}) {
+        for (size_t work : {size_t(0), size_t(1000), size_t(20000)}) {
+            runSchedulerBenchmark(tasks, work, 2000, schedulerCsv);
+        }
+    }
+    schedulerCsv.close();
+
+    // --- PHASE 17: FORCE LOAD BALANCING ---
+    std::cout << "\n--- Phase 17: Guided Chunks vs Cost-Balanced Ranges ---\n";
+
+    // Guided chunks adapt while the loop runs, cost-balanced ranges are planned from the last
+    // step's walks and keep each thread on one stretch of the tree
+    std::vector<SweepConfig> balanceRuns;
+    for (bool balanced : {false, true}) {
+        Options options;
+        options.builder = TreeBuilder::Parallel;
+        options.leafCapacity = 8;
+        options.costBalancing = balanced;
+        balanceRuns.push_back({0.5, options});
+    }
+    if (!runSweep("BALANCE.csv", balanceRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
+
+    // --- PHASE 18: WORKER PINNING ---
+    std::cout << "\n--- Phase 18: Floating vs Pinned Workers ---\n";
+
+    // Pinned runs also place the body and tree arrays on the nodes of the workers that loop
+    // over them. The gain shows on machines with several NUMA nodes; PinWorkers is 0 where
+    // pinning is not available
+    std::vector<SweepConfig> pinningRuns;
+    for (bool pin : {false, true}) {
+        Options options;
+        options.builder = TreeBuilder::Parallel;
+        options.leafCapacity = 8;
+        options.ordering = BodyOrdering::Hilbert;
+        options.pinWorkers = pin;
+        pinningRuns.push_back({0.5, options});
+    }
+    if (!runSweep("PINNING.csv", pinningRuns, testBodyCounts, ticksToRun, fixedDeltaT)) return;
 
-    csv.close();
     std::cout << "\n=== BENCHMARKS COMPLETE ===\n";
-}
\ No newline at end of file
+}
@@ -1,10 +1,10 @@
 #include "../headers/body.h"
 #include "raylib.h"
 
-Body::Body(double mass) : m_mass(mass), m_radius(0), m_position(Vec2()), m_velocity(Vec2()), m_acceleration(Vec2()),  m_color(WHITE)
+Body::Body(double mass) : m_mass(mass), m_radius(0), m_position(Vec2()), m_velocity(Vec2()), m_acceleration(Vec2()),  m_color(WHITE), m_id(0)
 {}
 
-Body::Body(double mass, double radius, Vec2 position, Vec2 velocity, Color color) : m_mass(mass), m_radius(radius), m_position(position), m_velocity(velocity), m_acceleration(Vec2()), m_color(color)
+Body::Body(double mass, double radius, Vec2 position, Vec2 velocity, Color color) : m_mass(mass), m_radius(radius), m_position(position), m_velocity(velocity), m_acceleration(Vec2()), m_color(color), m_id(0)
 {}
 
 // Leapfrog: velocity half-step (kick)
@@ -19,16 +19,21 @@ void Body::drift(years_t dt) {
 
 void Body::draw() const
 {
-    double screenX = GetScreenWidth() / 2.0 + m_position.getX() * SCALE;
-    double screenY = GetScreenHeight() / 2.0 + m_position.getY() * SCALE;
-    double screenRadius = m_radius * SCALE;
+    drawBody(m_position, m_radius, m_color);
+}
+
+void drawBody(Vec2 position, double radius, Color color)
+{
+    double screenX = GetScreenWidth() / 2.0 + position.getX() * SCALE;
+    double screenY = GetScreenHeight() / 2.0 + position.getY() * SCALE;
+    double screenRadius = radius * SCALE;
     
     if (screenRadius < 3.0) {
         screenRadius = 3.0;
     }
     
     // Draw the celestial body
-    DrawCircle(screenX, screenY, screenRadius, m_color);
+    DrawCircle(screenX, screenY, screenRadius, color);
 }
 
 // Generic setters and getters
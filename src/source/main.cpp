@@ -4,7 +4,12 @@
 
 int main() {
 
+    // `make benchmark` builds a separate executable that only runs the benchmarks
+#ifdef BENCHMARK_BUILD
+    bool run_benchmarks = true;
+#else
     bool run_benchmarks = false;
+#endif
     if(run_benchmarks)
     {
         benchmark::runAllBenchmarks();
@@ -1,4 +1,7 @@
 #include "../headers/simulation.h"
+#include "../utils/BatchMath.h"
+#include "../utils/Collision.h"
+#include "../utils/Topology.h"
 #include "raylib.h"
 #include <cmath>
 #include <random>
@@ -7,16 +10,43 @@
 #include <iostream>
 #include <cstdlib>
 #include <algorithm>
+#include <functional>
+#include <numeric>
+
+// Smallest chunks of the parallel loops, in bodies or tree groups. Streaming loops take
+// large even ranges; the tree walks vary per body, so they are handed out in small pieces
+static constexpr size_t STREAM_GRAIN = 4096;
+static constexpr size_t FORCE_GRAIN = 64;
+static constexpr size_t GROUP_GRAIN = 1;
+static constexpr size_t ENERGY_GRAIN = 16;
+
+// Pinned arrays are placed again once the body count moved by more than 1/PLACEMENT_DRIFT
+static constexpr size_t PLACEMENT_DRIFT = 4;
 
 // Default ctor sets bodies to stl vector default and puts timescale at 1 (real time)
 // Initialize quadtree with theta (default 0.5) and epsilon from constants
 Simulation::Simulation(double theta) 
-    : m_bodies(std::vector<Body>()), 
+    : m_bodies(), 
       m_timeScale(1.0),
       m_quadtree(Quadtree(theta, SOFTENING)),
+      m_fmm(theta, SOFTENING),
+      m_direct(SOFTENING),
       m_theta(theta),
+      m_treeBuilder(TreeBuilder::Insertion),
+      m_forceSolver(ForceSolver::BarnesHut),
+      m_groupSize(32),
+      m_directCrossover(512),
+      m_parallelPropagate(false),
+      m_refitThreshold(0.1),
+      m_bodyOrdering(BodyOrdering::None),
+      m_reorderInterval(0),
+      m_reorderThreshold(0.25),
       m_threadCount(std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 4),
       m_threadPool(m_threadCount),
+      m_interactionLists(m_threadCount),
+      m_threadArenas(m_threadCount),
+      m_slotForceMs(m_threadCount, 0.0),
+      m_slotBounds(m_threadCount),
       m_toggleWF(false)
 {
 }
@@ -26,62 +56,314 @@ Simulation::Simulation(double theta)
 // collisions.
 void Simulation::update(years_t deltaT, bool enableCollisions)
 {
+    applyRemovals();
     if (m_bodies.empty()) return;
 
-    //using namespace std::chrono;
+    m_frameArena.reset();
+    for (FrameArena& arena : m_threadArenas) {
+        arena.reset();
+    }
 
-    // 1. Leapfrog Kick & Drift
+    using namespace std::chrono;
+
+    // 1. Leapfrog Kick & Drift, finding the bounding box of the new positions on the way
     years_t half_dt = deltaT / 2.0;
-    for (auto& body : m_bodies) body.kick(half_dt);
-    for (auto& body : m_bodies) body.drift(deltaT);
+    std::fill(m_slotBounds.begin(), m_slotBounds.end(), Bounds());
+    m_threadPool.parallelFor(0, m_bodies.size(), STREAM_GRAIN, [&](size_t first, size_t last, size_t t) {
+        m_bodies.kickDrift(half_dt, deltaT, first, last, m_slotBounds[t]);
+    });
+    m_stepBounds = Bounds();
+    for (const Bounds& bounds : m_slotBounds) {
+        m_stepBounds.merge(bounds);
+    }
 
     // 2. Handle Collisions
-    //auto start_coll = high_resolution_clock::now();
+    auto start_coll = high_resolution_clock::now();
     if(enableCollisions) { handleCollisions(); } 
-    //auto end_coll = high_resolution_clock::now();
-    //m_lastCollisionTimeMs = duration<double, std::milli>(end_coll - start_coll).count();
-
-    // 3. Quadtree Build (Serial)
-    //auto start_tree = high_resolution_clock::now();
-    Quad boundingQuad = Quad::newContaining(m_bodies);
-    m_quadtree.reserve(m_bodies.size());
-    m_quadtree.clear(boundingQuad);
-    
-    for (const auto& body : m_bodies) {
-        m_quadtree.insert(body.getPos(), body.getMass());
+    auto end_coll = high_resolution_clock::now();
+    m_lastCollisionTimeMs = duration<double, std::milli>(end_coll - start_coll).count();
+
+    // 3. Quadtree Build, reordering the bodies first when their memory order has drifted.
+    // Direct sums straight from the body arrays, so then the tree is only built for the wireframe
+    auto start_tree = high_resolution_clock::now();
+    ForceSolver solver = getActiveForceSolver();
+    m_stepsSinceReorder++;
+    if (needsReorder()) { reorderBodies(); }
+    if (solver != ForceSolver::Direct || m_toggleWF) {
+        buildTree();
+        if (m_bodyOrdering != BodyOrdering::None) { measureScatter(); }
+    } else {
+        m_scatter = 0.0;
     }
-    m_quadtree.propagate();
-    //auto end_tree = high_resolution_clock::now();
-    //m_lastTreeTimeMs = duration<double, std::milli>(end_tree - start_tree).count();
-    
-    // 4. Barnes-Hut Force Calculation (Multithreaded)
-    //auto start_force = high_resolution_clock::now();
-    size_t bodiesPerThread = (m_bodies.size() + m_threadCount - 1) / m_threadCount;
+    if (m_pinWorkers && needsPlacement()) { placeOnWorkers(); }
+    auto end_tree = high_resolution_clock::now();
+    m_lastTreeTimeMs = duration<double, std::milli>(end_tree - start_tree).count();
     
-    for (size_t t = 0; t < m_threadCount; ++t) {
-        size_t start = t * bodiesPerThread;
-        size_t end = std::min(start + bodiesPerThread, m_bodies.size());
-        
-        if (start >= m_bodies.size()) break;
-        
-        m_threadPool.enqueue([this, start, end]() {
-            for (size_t i = start; i < end; ++i) {
-                m_bodies[i].setAcc(Vec2(0, 0));
-                Vec2 acceleration = m_quadtree.acc(m_bodies[i].getPos());
-                m_bodies[i].setAcc(acceleration);
+    // 4. Force Calculation (Multithreaded)
+    auto start_force = high_resolution_clock::now();
+    bool useFmm = solver == ForceSolver::Fmm;
+    if (useFmm) {
+        m_fmm.solve(m_quadtree, m_threadPool, m_threadCount);
+    }
+
+    if (solver == ForceSolver::Direct) {
+        m_direct.solve(m_bodies, m_threadPool, m_threadArenas);
+    } else if (solver == ForceSolver::GroupWalk && m_quadtree.hasBodyOrder()) {
+        computeGroupForces();
+    } else {
+        // Collecting first only pays off when the kernel summing the list is vectorized, and
+        // mixed precision only exists on the collected path
+        bool batched = getForceIsa() != ForceIsa::Scalar || m_quadtree.getMixedPrecision();
+        size_t n = m_bodies.size();
+        if (m_bodyCost.size() != n) {
+            // Bodies were added or loaded, start again from equal costs
+            m_bodyCost.assign(n, 1);
+        }
+
+        // Bodies of a slot's range in tree order when the builder keeps it, so neighbouring
+        // walks share the nodes they open
+        const uint32_t* order = m_quadtree.hasBodyOrder() ? m_quadtree.getBodyOrder().data() : nullptr;
+        std::fill(m_slotForceMs.begin(), m_slotForceMs.end(), 0.0);
+
+        auto forceRange = [&](size_t start, size_t end, size_t t) {
+            auto start_range = high_resolution_clock::now();
+            InteractionList& list = m_interactionLists[t];
+            const double* x = m_bodies.x();
+            const double* y = m_bodies.y();
+            double* ax = m_bodies.ax();
+            double* ay = m_bodies.ay();
+            for (size_t s = start; s < end; ++s) {
+                size_t i = order ? order[s] : s;
+                // Last step's acceleration, for the relative opening criterion
+                double accMag = std::sqrt(ax[i] * ax[i] + ay[i] * ay[i]);
+                Vec2 pos(x[i], y[i]);
+                Vec2 acceleration;
+                if (useFmm) {
+                    acceleration = m_fmm.acc(pos);
+                } else if (batched) {
+                    acceleration = m_quadtree.acc(pos, list, accMag, &m_bodyCost[i]);
+                } else {
+                    acceleration = m_quadtree.acc(pos, accMag, &m_bodyCost[i]);
+                }
+                ax[i] = acceleration.getX();
+                ay[i] = acceleration.getY();
             }
-        });
+            m_slotForceMs[t] += duration<double, std::milli>(high_resolution_clock::now() - start_range).count();
+        };
+
+        size_t slots;
+        if (m_costBalancing && !useFmm) {
+            // One range per thread holding an equal share of last step's interactions
+            partitionByCost(order);
+            size_t parts = m_costSplits.size() - 1;
+            slots = m_threadPool.getSlotCount(parts, 1);
+            m_threadPool.parallelFor(0, parts, 1, [&](size_t first, size_t last, size_t t) {
+                for (size_t p = first; p < last; ++p) {
+                    forceRange(m_costSplits[p], m_costSplits[p + 1], t);
+                }
+            });
+        } else {
+            // Guided, as bodies in dense regions open far more nodes than those on the outskirts
+            slots = m_threadPool.getSlotCount(n, FORCE_GRAIN);
+            m_threadPool.parallelFor(0, n, FORCE_GRAIN, forceRange, Schedule::Guided);
+        }
+
+        double slowest = *std::max_element(m_slotForceMs.begin(), m_slotForceMs.begin() + slots);
+        double mean = std::accumulate(m_slotForceMs.begin(), m_slotForceMs.begin() + slots, 0.0) / slots;
+        m_forceImbalance = mean > 0.0 ? slowest / mean : 1.0;
     }
-    m_threadPool.wait();
-    // auto end_force = high_resolution_clock::now();
-    //m_lastForceCalcTimeMs = duration<double, std::milli>(end_force - start_force).count();
+    auto end_force = high_resolution_clock::now();
+    m_lastForceCalcTimeMs = duration<double, std::milli>(end_force - start_force).count();
 
     // 5. Leapfrog Kick
-    for (auto& body : m_bodies) {
-        body.kick(half_dt);
+    m_threadPool.parallelFor(0, m_bodies.size(), STREAM_GRAIN, [&](size_t first, size_t last, size_t) {
+        m_bodies.kick(half_dt, first, last);
+    });
+}
+
+// Builds the Barnes-Hut tree for the current body positions, which lie inside m_stepBounds
+void Simulation::buildTree()
+{
+    Quad boundingQuad = Quad::containing(m_stepBounds);
+    m_quadtree.reserve(m_bodies.size());
+
+    if (m_treeBuilder == TreeBuilder::Morton) {
+        m_quadtree.buildMorton(m_bodies, boundingQuad);
+    } else if (m_treeBuilder == TreeBuilder::Parallel) {
+        m_quadtree.buildParallel(m_bodies, boundingQuad, m_threadPool, m_threadCount);
+    } else if (m_treeBuilder == TreeBuilder::Refit) {
+        if (!m_quadtree.refit(m_bodies, boundingQuad, m_refitThreshold)) {
+            // Extra room around the root so a slowly spreading system does not force a rebuild every step
+            const double REFIT_ROOT_PADDING = 1.25;
+            Quad paddedQuad(boundingQuad.center, boundingQuad.size * REFIT_ROOT_PADDING);
+            m_quadtree.buildParallel(m_bodies, paddedQuad, m_threadPool, m_threadCount);
+            m_quadtree.indexLeaves();
+        }
+    } else {
+        m_quadtree.clear(boundingQuad);
+        const double* x = m_bodies.x();
+        const double* y = m_bodies.y();
+        const double* mass = m_bodies.mass();
+        for (size_t i = 0; i < m_bodies.size(); ++i) {
+            m_quadtree.insert(Vec2(x[i], y[i]), mass[i]);
+        }
+    }
+
+    if (m_parallelPropagate) {
+        m_quadtree.propagateParallel(m_threadPool, m_threadCount);
+    } else {
+        m_quadtree.propagate();
     }
 }
 
+ForceSolver Simulation::getActiveForceSolver() const
+{
+    // A tree with theta = 0 opens every node, which is the same sum done more slowly
+    if (m_theta == 0.0 || m_bodies.size() < m_directCrossover) return ForceSolver::Direct;
+    return m_forceSolver;
+}
+
+bool Simulation::needsReorder() const
+{
+    if (m_bodyOrdering == BodyOrdering::None) return false;
+    if (m_reorderInterval > 0 && m_stepsSinceReorder >= m_reorderInterval) return true;
+    return m_scatter > m_reorderThreshold;
+}
+
+void Simulation::measureScatter()
+{
+    // Only the Morton-based builders and refit know the tree order of the bodies, with
+    // insert() reordering relies on the interval alone
+    const FieldVector<uint32_t>& order = m_quadtree.getBodyOrder();
+    if (!m_quadtree.hasBodyOrder() || order.size() != m_bodies.size() || order.size() < 2) {
+        m_scatter = 0.0;
+        return;
+    }
+
+    // Neighbours further apart than this in m_bodies are unlikely to share a cache line or page
+    const uint32_t NEAR_DISTANCE = 64;
+    size_t scattered = 0;
+    for (size_t i = 1; i < order.size(); ++i) {
+        uint32_t a = order[i - 1];
+        uint32_t b = order[i];
+        if ((a > b ? a - b : b - a) > NEAR_DISTANCE) scattered++;
+    }
+    m_scatter = static_cast<double>(scattered) / (order.size() - 1);
+}
+
+void Simulation::reorderBodies()
+{
+    m_stepsSinceReorder = 0;
+    size_t n = m_bodies.size();
+    if (n < 2 || m_bodyOrdering == BodyOrdering::None) return;
+
+    // The radix sort only looks at the 64-bit keys, so it sorts Hilbert keys just as well
+    Quad quad = Quad::newContaining(m_bodies);
+    bool hilbert = m_bodyOrdering == BodyOrdering::Hilbert;
+    m_reorderKeys.resize(n);
+    m_reorderIndex.resize(n);
+    const double* x = m_bodies.x();
+    const double* y = m_bodies.y();
+    for (size_t i = 0; i < n; ++i) {
+        Vec2 pos(x[i], y[i]);
+        m_reorderKeys[i] = hilbert ? quad.hilbertKey(pos) : quad.mortonKey(pos);
+        m_reorderIndex[i] = static_cast<uint32_t>(i);
+    }
+    mortonRadixSort(m_reorderKeys, m_reorderIndex, m_reorderKeyScratch, m_reorderIndexScratch);
+
+    m_bodies.permute(m_reorderIndex);
+    if (m_bodyCost.size() == n) {
+        m_costScratch.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            m_costScratch[i] = m_bodyCost[m_reorderIndex[i]];
+        }
+        m_bodyCost.swap(m_costScratch);
+    }
+
+    // The refit leaf index and the tree's body order point at the old slots
+    m_quadtree.invalidateLeafIndex();
+    m_scatter = 0.0;
+}
+
+bool Simulation::setPinWorkers(bool enabled)
+{
+    std::vector<int> cpus;
+    if (enabled) {
+        cpus = CpuTopology::detect().workerCpus(m_threadCount);
+    }
+    bool pinned = m_threadPool.setAffinity(cpus);
+    if (enabled && !pinned) {
+        // Some workers were refused, let all of them float rather than pin half
+        m_threadPool.setAffinity({});
+    }
+    m_pinWorkers = enabled && pinned;
+
+    // Pages already touched stay put, so copy the arrays over once the workers are pinned
+    m_placedBodies = 0;
+    return m_pinWorkers == enabled;
+}
+
+void Simulation::placeOnWorkers()
+{
+    // The grain of the streaming loops, so each worker gets back the ranges it placed
+    m_bodies.placeOnWorkers(m_threadPool, STREAM_GRAIN);
+    m_quadtree.placeOnWorkers(m_threadPool, STREAM_GRAIN);
+    m_placedBodies = m_bodies.size();
+    m_placedCapacity = m_bodies.capacity();
+    m_placedTreeCapacity = m_quadtree.getBodyOrder().capacity();
+}
+
+bool Simulation::needsPlacement() const
+{
+    if (m_placedBodies == 0) return !m_bodies.empty();
+
+    // A reallocated array was copied by one thread. Merges only shrink the arrays, which moves
+    // no pages, so small changes in the count keep the placement
+    size_t drift = m_bodies.size() > m_placedBodies ? m_bodies.size() - m_placedBodies : m_placedBodies - m_bodies.size();
+    return m_bodies.capacity() != m_placedCapacity
+        || m_quadtree.getBodyOrder().capacity() != m_placedTreeCapacity
+        || drift > m_placedBodies / PLACEMENT_DRIFT;
+}
+
+void Simulation::partitionByCost(const uint32_t* order)
+{
+    size_t n = m_bodies.size();
+    size_t parts = std::min(m_threadCount, n);
+    m_costSplits.resize(parts + 1);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        total += m_bodyCost[i];
+    }
+
+    // Part p ends at the first body where the running cost reaches p / parts of the total
+    uint64_t running = 0;
+    size_t part = 1;
+    m_costSplits[0] = 0;
+    for (size_t s = 0; s < n && part < parts; ++s) {
+        running += m_bodyCost[order ? order[s] : s];
+        while (part < parts && running * parts >= total * part) {
+            m_costSplits[part++] = s + 1;
+        }
+    }
+    while (part <= parts) {
+        m_costSplits[part++] = n;
+    }
+}
+
+void Simulation::computeGroupForces()
+{
+    m_quadtree.buildGroups(m_groupSize);
+    size_t groupCount = m_quadtree.getGroupCount();
+
+    // Groups are in tree order, so the large early chunks of a guided loop stay spatially compact
+    m_threadPool.parallelFor(0, groupCount, GROUP_GRAIN, [&](size_t start, size_t end, size_t t) {
+        for (size_t g = start; g < end; ++g) {
+            m_quadtree.accGroup(g, m_bodies, m_interactionLists[t]);
+        }
+    }, Schedule::Guided);
+}
+
 // RK4
 // void Simulation::update(years_t deltaT)
 // {
@@ -182,18 +464,22 @@ void Simulation::update(years_t deltaT, bool enableCollisions)
 // }
 
 // Adds body to simulation
-Body* Simulation::addBody(Body body)
+uint32_t Simulation::addBody(Body body)
 {
-    m_bodies.push_back(body);
-    return &m_bodies.back();
+    return m_bodies.insert(body);
 }
 
 void Simulation::render()
 {
+    // Removals made while paused should disappear right away
+    applyRemovals();
+
     // Renders bodies
-    for (const Body &body : m_bodies)
+    const double* radius = m_bodies.radius();
+    const Color* color = m_bodies.color();
+    for (size_t i = 0; i < m_bodies.size(); ++i)
     {
-        body.draw();
+        drawBody(m_bodies[i].getPos(), radius[i], color[i]);
     }
     if( m_toggleWF ) { m_quadtree.render(); } 
 }
@@ -201,8 +487,12 @@ void Simulation::render()
 // Removes all bodies from current simulation
 void Simulation::reset()
 {
+    // Ids held from before the reset never find a new body, the store retires them
     m_bodies.clear();
+    m_pendingRemovals.clear();
     m_timeScale = 1.0;
+    m_stepsSinceReorder = 0;
+    m_scatter = 1.0; // Nothing is known about the layout of the next bodies, sort them on the first step
 }
 
 void Simulation::saveSimulation(const std::string& filename)
@@ -217,10 +507,19 @@ void Simulation::saveSimulation(const std::string& filename)
     size_t count = m_bodies.size();
     file.write(reinterpret_cast<const char*>(&count), sizeof(size_t));
 
-    // Write the entire vector data block directly
+    // Write the bodies in slot order (creation order unless bodies were removed), so the file
+    // does not depend on when they were last reordered.
     // This assumes Body contains no pointers or std::string
     if (count > 0) {
-        file.write(reinterpret_cast<const char*>(m_bodies.data()), count * sizeof(Body));
+        std::vector<Body> sorted;
+        sorted.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            sorted.push_back(m_bodies.get(i));
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const Body& a, const Body& b) {
+            return (a.m_id & BodyStore::MAX_BODIES) < (b.m_id & BodyStore::MAX_BODIES);
+        });
+        file.write(reinterpret_cast<const char*>(sorted.data()), count * sizeof(Body));
     }
 
     file.close();
@@ -241,12 +540,16 @@ void Simulation::loadSimulation(const std::string& filename)
     file.read(reinterpret_cast<char*>(&count), sizeof(size_t));
 
     if (count > 0) {
-        // Resize vector to allocate the exact memory needed
+        // Files hold Body records, so read them as a block and split them into the store's arrays.
         // This requires Body to have a default constructor (which your code implies it does)
-        m_bodies.resize(count);
+        std::vector<Body> loaded(count);
+        file.read(reinterpret_cast<char*>(loaded.data()), count * sizeof(Body));
 
-        // Read the data block directly into the vector's memory
-        file.read(reinterpret_cast<char*>(m_bodies.data()), count * sizeof(Body));
+        // Ids in the file are ignored, loaded bodies get new ones in file order
+        m_bodies.reserve(count);
+        for (const Body& body : loaded) {
+            m_bodies.insert(body);
+        }
     }
 
     file.close();
@@ -354,8 +657,9 @@ void Simulation::loadPreset(int presetID, int numBodies)
 void Simulation::setTheta(double theta)
 {
     m_theta = theta;
-    // Reinitialize quadtree with new theta
-    m_quadtree = Quadtree(m_theta, SOFTENING);
+    // Update in place so builder settings such as leaf capacity survive
+    m_quadtree.setTheta(m_theta);
+    m_fmm.setTheta(m_theta);
 }
 
 // Generates a protoplanetary disk of bodies around a central point
@@ -437,24 +741,65 @@ void Simulation::generateProPlanetaryDisk(int count, Vec2 centerPoint, Vec2 velo
 }
 
 void Simulation::DeleteBodyAt(Vec2 worldPos) {
-    for( auto body = m_bodies.rbegin(); body != m_bodies.rend(); ++body ) {
-        if( body->getPos() == worldPos ) {
-            m_bodies.erase( std::next(body).base() );
+    for( size_t i = m_bodies.size(); i-- > 0; ) {
+        if( m_bodies[i].getPos() == worldPos ) {
+            removeBody( m_bodies[i].getId() );
             break;
         }
     }
 }
 
-Body *Simulation::getBodyAt(Vec2 worldPos)
+void Simulation::removeBody(uint32_t id)
+{
+    if (id != NO_BODY_ID) m_pendingRemovals.push_back(id);
+}
+
+void Simulation::applyRemovals()
+{
+    if (m_pendingRemovals.empty()) return;
+
+    m_removalIndices.clear();
+    for (uint32_t id : m_pendingRemovals) {
+        size_t index = m_bodies.indexOf(id);
+        if (index != BodyStore::NOT_FOUND) m_removalIndices.push_back(index);
+    }
+    m_pendingRemovals.clear();
+
+    // Highest index first, so the last body moved into a gap is never one still to be removed
+    std::sort(m_removalIndices.begin(), m_removalIndices.end(), std::greater<size_t>());
+    m_removalIndices.erase(std::unique(m_removalIndices.begin(), m_removalIndices.end()), m_removalIndices.end());
+    bool trackCost = m_bodyCost.size() == m_bodies.size();
+    for (size_t index : m_removalIndices) {
+        m_bodies.remove(index);
+        if (trackCost) {
+            // Same move as BodyStore::remove, so the costs stay with their bodies
+            m_bodyCost[index] = m_bodyCost.back();
+            m_bodyCost.pop_back();
+        }
+    }
+
+    // The tree's leaf index refers to bodies by index
+    m_quadtree.invalidateLeafIndex();
+}
+
+std::optional<BodyRef> Simulation::findBody(uint32_t id)
+{
+    size_t index = m_bodies.indexOf(id);
+    if (index == BodyStore::NOT_FOUND) return std::nullopt;
+    return m_bodies[index];
+}
+
+std::optional<BodyRef> Simulation::getBodyAt(Vec2 worldPos)
 {
     double halfWidth = GetScreenWidth() / 2.0;
     double halfHeight = GetScreenHeight() / 2.0;
 
-    for( auto body = m_bodies.rbegin(); body != m_bodies.rend(); ++body ) {
+    for( size_t i = m_bodies.size(); i-- > 0; ) {
+        BodyRef body = m_bodies[i];
         
         // Convert the Body's Physics Position to "Visual Position"
-        double visualX = halfWidth + body->getPos().getX() * SCALE;
-        double visualY = halfHeight + body->getPos().getY() * SCALE;
+        double visualX = halfWidth + body.getPos().getX() * SCALE;
+        double visualY = halfHeight + body.getPos().getY() * SCALE;
 
         // 3. Calculate Distance in Visual/Pixel Space
         double dx = worldPos.getX() - visualX;
@@ -462,166 +807,114 @@ Body *Simulation::getBodyAt(Vec2 worldPos)
         double distSq = dx*dx + dy*dy;
         
         // Calculate Visual Radius (including the minimum 3.0 pixel clamp)
-        double visualRadius = body->getRadius() * SCALE;
+        double visualRadius = body.getRadius() * SCALE;
         if (visualRadius < 3.0) {
             visualRadius = 3.0;
         }
 
         // Check collision
         if (distSq <= (visualRadius * visualRadius)) {
-            return &(*body);
+            return body;
         }
     }
-    return nullptr;
+    return std::nullopt;
 }
 
 void Simulation::handleCollisions() {
     size_t n = m_bodies.size();
     if (n < 2) return;
 
-    // 1. Structure to hold AABB (Axis-Aligned Bounding Box) data
-    struct Bound {
-        size_t id;
+    // 1. Sort bodies by their left-most X edge, carrying only the key and the index
+    struct SweepKey {
         double minX;
-        double maxX;
-        double minY;
-        double maxY;
+        uint32_t id;
     };
 
-    // We can make this a class member (std::vector<Bound> m_bounds) 
-    // in the future to avoid reallocation, but a local vector is fine for now
-    std::vector<Bound> bounds(n);
-    for (size_t i = 0; i < n; ++i) {
-        double r = m_bodies[i].getRadius();
-        Vec2 pos = m_bodies[i].getPos();
-        bounds[i] = {i, pos.getX() - r, pos.getX() + r, pos.getY() - r, pos.getY() + r};
-    }
+    SweepKey* keys = m_frameArena.alloc<SweepKey>(n);
+    const double* x = m_bodies.x();
+    const double* y = m_bodies.y();
+    const double* radius = m_bodies.radius();
+    m_threadPool.parallelFor(0, n, STREAM_GRAIN, [&](size_t first, size_t last, size_t) {
+        for (size_t i = first; i < last; ++i) {
+            keys[i] = {x[i] - radius[i], static_cast<uint32_t>(i)};
+        }
+    });
 
-    // 2. Sort bodies by their left-most X edge
-    std::sort(bounds.begin(), bounds.end(), [](const Bound& a, const Bound& b) {
+    std::sort(keys, keys + n, [](const SweepKey& a, const SweepKey& b) {
         return a.minX < b.minX;
     });
 
-    // 3. Sweep and Prune (1D Axis Sweep)
-    for (size_t i = 0; i < n; ++i) {
-        for (size_t j = i + 1; j < n; ++j) {
-            
-            // THE MAGIC: If the next body's left edge is further right than our right edge,
-            // NO further bodies in the sorted list can possibly intersect with us. Break early!
-            if (bounds[j].minX > bounds[i].maxX) {
-                break;
-            }
-
-            // Quick Y-axis AABB check before doing expensive square roots
-            if (bounds[i].minY > bounds[j].maxY || bounds[i].maxY < bounds[j].minY) {
-                continue;
-            }
-
-            // Only perform the exact circle collision if the AABBs overlap
-            resolveCollision(m_bodies[bounds[i].id], m_bodies[bounds[j].id], 0.5);
+    // 2. AABBs (Axis-Aligned Bounding Boxes) in sweep order, one array per edge so the
+    // sweep below only streams the edges it compares
+    double* minX = m_frameArena.alloc<double>(n);
+    double* maxX = m_frameArena.alloc<double>(n);
+    double* minY = m_frameArena.alloc<double>(n);
+    double* maxY = m_frameArena.alloc<double>(n);
+    m_threadPool.parallelFor(0, n, STREAM_GRAIN, [&](size_t first, size_t last, size_t) {
+        for (size_t i = first; i < last; ++i) {
+            uint32_t id = keys[i].id;
+            double r = radius[id];
+            minX[i] = keys[i].minX;
+            maxX[i] = x[id] + r;
+            minY[i] = y[id] - r;
+            maxY[i] = y[id] + r;
         }
-    }
-}
-
-void Simulation::resolveCollision(Body& b1, Body& b2, double restitution) {
-    Vec2 delta = b1.getPos() - b2.getPos();
-    double distSq = delta.magSqrd();
-    double radiusSum = b1.getRadius() + b2.getRadius();
-
-    // Check if they are overlapping
-    if (distSq >= radiusSum * radiusSum || distSq == 0.0) return;
-
-    double dist = std::sqrt(distSq);
-    Vec2 normal = delta / dist;
-
-    // Positional Correction (with "slop" and relaxation)
-    const double ALLOWED_PENETRATION = 0.01; 
-    const double POSITIONAL_PERCENT = 0.8;
-    
-    double overlap = radiusSum - dist;
-    
-    if (overlap > ALLOWED_PENETRATION) {
-        double totalMass = b1.getMass() + b2.getMass(); 
-        double m1Ratio = b2.getMass() / totalMass; 
-        double m2Ratio = b1.getMass() / totalMass; 
-
-        // Multiply the correction by our new percentage
-        b1.setPos(b1.getPos() + normal * (overlap * m1Ratio * POSITIONAL_PERCENT)); 
-        b2.setPos(b2.getPos() - normal * (overlap * m2Ratio * POSITIONAL_PERCENT)); 
-    }
-
-    // Velocity Resolution (Normal Impulse)
-    Vec2 relVel = b1.getVel() - b2.getVel(); 
-    double velAlongNormal = relVel.dot(normal); 
+    });
 
-    // If velocities are separating, don't resolve
-    if (velAlongNormal > 0) return; 
+    // 3. Sweep and Prune (1D Axis Sweep)
+    sweepAndPrune<2>(n, {minX, minY}, {maxX, maxY}, [&](size_t i, size_t j) {
+        // Only perform the exact circle collision if the AABBs overlap
+        uint32_t a = keys[i].id;
+        uint32_t b = keys[j].id;
+        resolveCollision(m_bodies[a], m_bodies[b], 0.5);
+
+        // Separating the pair may push one of them out of the box the drift found
+        m_stepBounds.include(x[a], y[a]);
+        m_stepBounds.include(x[b], y[b]);
+    });
+}
 
-    // A higher threshold aggressively kills kinetic energy 
-    // for objects caught in strong gravity wells.
-    const double RESTING_THRESHOLD = 1.0; 
-    
-    double actualRestitution = restitution;
-    if (std::abs(velAlongNormal) < RESTING_THRESHOLD) {
-        actualRestitution = 0.0; // Force a dead stop
+void Simulation::resolveCollision(BodyRef b1, BodyRef b2, double restitution) {
+    Vec2 p1 = b1.getPos();
+    Vec2 p2 = b2.getPos();
+    Vec2 v1 = b1.getVel();
+    Vec2 v2 = b2.getVel();
+    if (!resolveContact(p1, v1, b1.getMass(), b1.getRadius(), p2, v2, b2.getMass(), b2.getRadius(), restitution)) {
+        return;
     }
 
-    double j = -(1.0 + actualRestitution) * velAlongNormal; 
-    j /= (1.0 / b1.getMass() + 1.0 / b2.getMass()); 
-
-    Vec2 normalImpulse = normal * j; 
-    
-    b1.setVel(b1.getVel() + normalImpulse / b1.getMass()); 
-    b2.setVel(b2.getVel() - normalImpulse / b2.getMass()); 
-
-    // Friction (Tangential Impulse)
-    // In 2D, the tangent is perpendicular to the normal. If normal is (x, y), tangent is (-y, x).
-    Vec2 tangent(-normal.getY(), normal.getX()); 
-    
-    // Recalculate relative velocity after the normal impulse was applied
-    Vec2 newRelVel = b1.getVel() - b2.getVel(); 
-    double velAlongTangent = newRelVel.dot(tangent); 
-    
-    // Calculate the tangential impulse scalar
-    double jt = -velAlongTangent; 
-    jt /= (1.0 / b1.getMass() + 1.0 / b2.getMass()); 
-    
-    // Coulomb friction law: friction is proportional to the normal force (impulse)
-    const double FRICTION_COEFFICIENT = 0.5; // 0.0 = ice, 1.0+ = very sticky
-    double maxFriction = std::abs(j) * FRICTION_COEFFICIENT; 
-    
-    // Clamp the tangential impulse so it doesn't exceed static friction
-    if (jt > maxFriction) {
-        jt = maxFriction; 
-    } else if (jt < -maxFriction) {
-        jt = -maxFriction; 
-    }
-    
-    Vec2 frictionImpulse = tangent * jt; 
-    
-    // Apply friction impulse
-    b1.setVel(b1.getVel() + frictionImpulse / b1.getMass()); 
-    b2.setVel(b2.getVel() - frictionImpulse / b2.getMass()); 
+    b1.setPos(p1);
+    b2.setPos(p2);
+    b1.setVel(v1);
+    b2.setVel(v2);
 }
 
 double Simulation::calculateTotalEnergy() const {
     double kineticEnergy = 0.0;
     double potentialEnergy = 0.0;
-    int n = m_bodies.size();
+    size_t n = m_bodies.size();
 
-    // 1. Calculate Total Kinetic Energy
-    for (const auto& body : m_bodies) {
-        double vSq = body.getVel().magSqrd();
-        kineticEnergy += 0.5 * body.getMass() * vSq;
-    }
+    const double* x = m_bodies.x();
+    const double* y = m_bodies.y();
+    const double* vx = m_bodies.vx();
+    const double* vy = m_bodies.vy();
+    const double* mass = m_bodies.mass();
 
-    // 2. Calculate Total Potential Energy 
-    for (int i = 0; i < n; ++i) {
-        for (int j = i + 1; j < n; ++j) {
-            Vec2 delta = m_bodies[i].getPos() - m_bodies[j].getPos();
-            double dist = std::sqrt(delta.magSqrd() + SOFTENING); 
-            potentialEnergy -= (GC * m_bodies[i].getMass() * m_bodies[j].getMass()) / dist;
+    // 1. Calculate Total Kinetic Energy
+    kineticEnergy = sumKineticEnergy(n, vx, vy, mass);
+
+    // 2. Calculate Total Potential Energy, each pair once. Row i pairs body i with the n - i - 1
+    // bodies after it, so the rows shrink and are handed out guided. Each row's term is kept
+    // and summed in order afterwards, so the total does not depend on the thread count
+    std::vector<double> rows(n, 0.0);
+    m_threadPool.parallelFor(0, n > 0 ? n - 1 : 0, ENERGY_GRAIN, [&](size_t first, size_t last, size_t) {
+        for (size_t i = first; i < last; ++i) {
+            double others = sumInverseDistance(n - i - 1, x + i + 1, y + i + 1, mass + i + 1, x[i], y[i], SOFTENING);
+            rows[i] = GC * mass[i] * others;
         }
+    }, Schedule::Guided);
+    for (size_t i = 0; i + 1 < n; ++i) {
+        potentialEnergy -= rows[i];
     }
 
     return kineticEnergy + potentialEnergy;
@@ -0,0 +1,14 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+#include <cstddef>
+
+// Number of heap allocations made through operator new since the program started, on any
+// thread, including over-aligned ones. Compare two readings to count the allocations of a
+// piece of code. Only the benchmark build (BENCHMARK_BUILD, see `make benchmark`) replaces
+// operator new, elsewhere this stays 0
+size_t allocationCount();
+
+// True when allocationCount() is counting, i.e. in the benchmark build
+bool countingAllocations();
+
+#endif // ALLOCATIONCOUNTER_H
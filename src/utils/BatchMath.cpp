@@ -0,0 +1,288 @@
+#include "BatchMath.h"
+#include <cmath>
+#include "ForceKernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_MATH_X86
+#include <immintrin.h>
+#endif
+
+using AxpyKernel = void (*)(size_t, double, const double*, double*);
+using KineticKernel = double (*)(size_t, const double*, const double*, const double*);
+using KickDriftKernel = void (*)(size_t, double, double, const double*, const double*, double*, double*, double*, double*, Bounds&);
+using InverseDistanceKernel = double (*)(size_t, const double*, const double*, const double*, double, double, double);
+
+static void axpyScalar(size_t n, double a, const double* x, double* y) {
+    for (size_t i = 0; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+static void kickDriftScalar(size_t n, double kickDt, double driftDt, const double* ax, const double* ay,
+                            double* vx, double* vy, double* x, double* y, Bounds& bounds) {
+    for (size_t i = 0; i < n; ++i) {
+        vx[i] += kickDt * ax[i];
+        vy[i] += kickDt * ay[i];
+        x[i] += driftDt * vx[i];
+        y[i] += driftDt * vy[i];
+        bounds.include(x[i], y[i]);
+    }
+}
+
+static double kineticScalar(size_t n, const double* vx, const double* vy, const double* mass) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += mass[i] * (vx[i] * vx[i] + vy[i] * vy[i]);
+    }
+    return 0.5 * sum;
+}
+
+static double inverseDistanceScalar(size_t n, const double* x, const double* y, const double* mass,
+                                    double px, double py, double softening) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double dx = x[i] - px;
+        double dy = y[i] - py;
+        sum += mass[i] / std::sqrt(dx * dx + dy * dy + softening);
+    }
+    return sum;
+}
+
+#if defined(BATCH_MATH_X86) && defined(__SSE2__)
+#define BATCH_MATH_SSE2
+
+static void axpySse2(size_t n, double a, const double* x, double* y) {
+    const __m128d av = _mm_set1_pd(a);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(av, _mm_loadu_pd(x + i))));
+    }
+    axpyScalar(n - i, a, x + i, y + i);
+}
+
+static void kickDriftSse2(size_t n, double kickDt, double driftDt, const double* ax, const double* ay,
+                          double* vx, double* vy, double* x, double* y, Bounds& bounds) {
+    const __m128d kick = _mm_set1_pd(kickDt);
+    const __m128d drift = _mm_set1_pd(driftDt);
+    __m128d minX = _mm_set1_pd(bounds.minX);
+    __m128d minY = _mm_set1_pd(bounds.minY);
+    __m128d maxX = _mm_set1_pd(bounds.maxX);
+    __m128d maxY = _mm_set1_pd(bounds.maxY);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d u = _mm_add_pd(_mm_loadu_pd(vx + i), _mm_mul_pd(kick, _mm_loadu_pd(ax + i)));
+        __m128d v = _mm_add_pd(_mm_loadu_pd(vy + i), _mm_mul_pd(kick, _mm_loadu_pd(ay + i)));
+        __m128d px = _mm_add_pd(_mm_loadu_pd(x + i), _mm_mul_pd(drift, u));
+        __m128d py = _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(drift, v));
+        _mm_storeu_pd(vx + i, u);
+        _mm_storeu_pd(vy + i, v);
+        _mm_storeu_pd(x + i, px);
+        _mm_storeu_pd(y + i, py);
+        minX = _mm_min_pd(minX, px);
+        minY = _mm_min_pd(minY, py);
+        maxX = _mm_max_pd(maxX, px);
+        maxY = _mm_max_pd(maxY, py);
+    }
+
+    alignas(16) double lanes[4][2];
+    _mm_store_pd(lanes[0], minX);
+    _mm_store_pd(lanes[1], minY);
+    _mm_store_pd(lanes[2], maxX);
+    _mm_store_pd(lanes[3], maxY);
+    for (int l = 0; l < 2; ++l) {
+        bounds.merge(Bounds{lanes[0][l], lanes[1][l], lanes[2][l], lanes[3][l]});
+    }
+    kickDriftScalar(n - i, kickDt, driftDt, ax + i, ay + i, vx + i, vy + i, x + i, y + i, bounds);
+}
+
+static double kineticSse2(size_t n, const double* vx, const double* vy, const double* mass) {
+    __m128d sum = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d u = _mm_loadu_pd(vx + i);
+        __m128d v = _mm_loadu_pd(vy + i);
+        __m128d vSq = _mm_add_pd(_mm_mul_pd(u, u), _mm_mul_pd(v, v));
+        sum = _mm_add_pd(sum, _mm_mul_pd(_mm_loadu_pd(mass + i), vSq));
+    }
+
+    alignas(16) double lanes[2];
+    _mm_store_pd(lanes, sum);
+    return 0.5 * (lanes[0] + lanes[1]) + kineticScalar(n - i, vx + i, vy + i, mass + i);
+}
+
+static double inverseDistanceSse2(size_t n, const double* x, const double* y, const double* mass,
+                                  double px, double py, double softening) {
+    const __m128d pxv = _mm_set1_pd(px);
+    const __m128d pyv = _mm_set1_pd(py);
+    const __m128d soft = _mm_set1_pd(softening);
+    __m128d sum = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + i), pxv);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(y + i), pyv);
+        __m128d rSq = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), soft);
+        sum = _mm_add_pd(sum, _mm_div_pd(_mm_loadu_pd(mass + i), _mm_sqrt_pd(rSq)));
+    }
+
+    alignas(16) double lanes[2];
+    _mm_store_pd(lanes, sum);
+    return (lanes[0] + lanes[1]) + inverseDistanceScalar(n - i, x + i, y + i, mass + i, px, py, softening);
+}
+
+#endif // BATCH_MATH_SSE2
+
+#ifdef BATCH_MATH_X86
+
+__attribute__((target("avx2,fma")))
+static void axpyAvx2(size_t n, double a, const double* x, double* y) {
+    const __m256d av = _mm256_set1_pd(a);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(y + i, _mm256_fmadd_pd(av, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    }
+
+    // Fused like the vector loop, so a result does not depend on where a range starts
+    for (; i < n; ++i) {
+        y[i] = std::fma(a, x[i], y[i]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void kickDriftAvx2(size_t n, double kickDt, double driftDt, const double* ax, const double* ay,
+                          double* vx, double* vy, double* x, double* y, Bounds& bounds) {
+    const __m256d kick = _mm256_set1_pd(kickDt);
+    const __m256d drift = _mm256_set1_pd(driftDt);
+    __m256d minX = _mm256_set1_pd(bounds.minX);
+    __m256d minY = _mm256_set1_pd(bounds.minY);
+    __m256d maxX = _mm256_set1_pd(bounds.maxX);
+    __m256d maxY = _mm256_set1_pd(bounds.maxY);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d u = _mm256_fmadd_pd(kick, _mm256_loadu_pd(ax + i), _mm256_loadu_pd(vx + i));
+        __m256d v = _mm256_fmadd_pd(kick, _mm256_loadu_pd(ay + i), _mm256_loadu_pd(vy + i));
+        __m256d px = _mm256_fmadd_pd(drift, u, _mm256_loadu_pd(x + i));
+        __m256d py = _mm256_fmadd_pd(drift, v, _mm256_loadu_pd(y + i));
+        _mm256_storeu_pd(vx + i, u);
+        _mm256_storeu_pd(vy + i, v);
+        _mm256_storeu_pd(x + i, px);
+        _mm256_storeu_pd(y + i, py);
+        minX = _mm256_min_pd(minX, px);
+        minY = _mm256_min_pd(minY, py);
+        maxX = _mm256_max_pd(maxX, px);
+        maxY = _mm256_max_pd(maxY, py);
+    }
+
+    // Unaligned stores, as in kineticAvx2
+    double lanes[4][4];
+    _mm256_storeu_pd(lanes[0], minX);
+    _mm256_storeu_pd(lanes[1], minY);
+    _mm256_storeu_pd(lanes[2], maxX);
+    _mm256_storeu_pd(lanes[3], maxY);
+    for (int l = 0; l < 4; ++l) {
+        bounds.merge(Bounds{lanes[0][l], lanes[1][l], lanes[2][l], lanes[3][l]});
+    }
+
+    // Fused like axpyAvx2's tail
+    for (; i < n; ++i) {
+        vx[i] = std::fma(kickDt, ax[i], vx[i]);
+        vy[i] = std::fma(kickDt, ay[i], vy[i]);
+        x[i] = std::fma(driftDt, vx[i], x[i]);
+        y[i] = std::fma(driftDt, vy[i], y[i]);
+        bounds.include(x[i], y[i]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static double kineticAvx2(size_t n, const double* vx, const double* vy, const double* mass) {
+    __m256d sum = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d u = _mm256_loadu_pd(vx + i);
+        __m256d v = _mm256_loadu_pd(vy + i);
+        __m256d vSq = _mm256_fmadd_pd(u, u, _mm256_mul_pd(v, v));
+        sum = _mm256_fmadd_pd(_mm256_loadu_pd(mass + i), vSq, sum);
+    }
+
+    // Unaligned store, MinGW does not keep the stack 32-byte aligned for alignas(32) locals
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    return 0.5 * ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + kineticScalar(n - i, vx + i, vy + i, mass + i);
+}
+
+__attribute__((target("avx2,fma")))
+static double inverseDistanceAvx2(size_t n, const double* x, const double* y, const double* mass,
+                                  double px, double py, double softening) {
+    const __m256d pxv = _mm256_set1_pd(px);
+    const __m256d pyv = _mm256_set1_pd(py);
+    const __m256d soft = _mm256_set1_pd(softening);
+    __m256d sum = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), pxv);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i), pyv);
+        __m256d rSq = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, soft));
+        sum = _mm256_add_pd(sum, _mm256_div_pd(_mm256_loadu_pd(mass + i), _mm256_sqrt_pd(rSq)));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]))
+        + inverseDistanceScalar(n - i, x + i, y + i, mass + i, px, py, softening);
+}
+
+#endif // BATCH_MATH_X86
+
+// Widest version this CPU runs, decided once
+static bool useAvx2() {
+#ifdef BATCH_MATH_X86
+    return forceIsaSupported(ForceIsa::Avx2);
+#else
+    return false;
+#endif
+}
+
+static const bool g_avx2 = useAvx2();
+
+#if defined(BATCH_MATH_X86) && defined(BATCH_MATH_SSE2)
+static const AxpyKernel g_axpy = g_avx2 ? axpyAvx2 : axpySse2;
+static const KickDriftKernel g_kickDrift = g_avx2 ? kickDriftAvx2 : kickDriftSse2;
+static const KineticKernel g_kinetic = g_avx2 ? kineticAvx2 : kineticSse2;
+static const InverseDistanceKernel g_inverseDistance = g_avx2 ? inverseDistanceAvx2 : inverseDistanceSse2;
+#elif defined(BATCH_MATH_X86)
+static const AxpyKernel g_axpy = g_avx2 ? axpyAvx2 : axpyScalar;
+static const KickDriftKernel g_kickDrift = g_avx2 ? kickDriftAvx2 : kickDriftScalar;
+static const KineticKernel g_kinetic = g_avx2 ? kineticAvx2 : kineticScalar;
+static const InverseDistanceKernel g_inverseDistance = g_avx2 ? inverseDistanceAvx2 : inverseDistanceScalar;
+#else
+static const AxpyKernel g_axpy = axpyScalar;
+static const KickDriftKernel g_kickDrift = kickDriftScalar;
+static const KineticKernel g_kinetic = kineticScalar;
+static const InverseDistanceKernel g_inverseDistance = inverseDistanceScalar;
+#endif
+
+void axpy(size_t n, double a, const double* x, double* y) {
+    g_axpy(n, a, x, y);
+}
+
+void kickDrift(size_t n, double kickDt, double driftDt, const double* ax, const double* ay,
+               double* vx, double* vy, double* x, double* y, Bounds& bounds) {
+    g_kickDrift(n, kickDt, driftDt, ax, ay, vx, vy, x, y, bounds);
+}
+
+double sumKineticEnergy(size_t n, const double* vx, const double* vy, const double* mass) {
+    return g_kinetic(n, vx, vy, mass);
+}
+
+double sumInverseDistance(size_t n, const double* x, const double* y, const double* mass,
+                          double px, double py, double softening) {
+    return g_inverseDistance(n, x, y, mass, px, py, softening);
+}
+
+const char* batchMathIsaName() {
+    if (g_avx2) return "AVX2";
+#ifdef BATCH_MATH_SSE2
+    return "SSE2";
+#else
+    return "Scalar";
+#endif
+}
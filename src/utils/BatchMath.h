@@ -0,0 +1,56 @@
+#ifndef BATCHMATH_H
+#define BATCHMATH_H
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+
+// Whole-array updates over structure-of-arrays fields, such as the BodyStore arrays.
+// Each function has an AVX2 and an SSE2 version and a portable loop for other CPUs; the
+// widest one the CPU supports is picked once at startup. These passes are limited by memory
+// bandwidth rather than arithmetic, so unlike the force kernels they do not follow setForceIsa.
+
+// y[i] += a * x[i] for i in [0, n), e.g. a kick (v += a * dt) or a drift (x += v * dt)
+void axpy(size_t n, double a, const double* x, double* y);
+
+// Smallest axis-aligned box around a set of points, empty (min above max) until one is added
+struct Bounds {
+    double minX = std::numeric_limits<double>::max();
+    double minY = std::numeric_limits<double>::max();
+    double maxX = std::numeric_limits<double>::lowest();
+    double maxY = std::numeric_limits<double>::lowest();
+
+    bool empty() const { return minX > maxX; }
+
+    void include(double x, double y) {
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+    }
+
+    void merge(const Bounds& other) {
+        minX = std::min(minX, other.minX);
+        minY = std::min(minY, other.minY);
+        maxX = std::max(maxX, other.maxX);
+        maxY = std::max(maxY, other.maxY);
+    }
+};
+
+// A leapfrog kick and drift in one pass: v += a * kickDt, then x += v * driftDt, for i in
+// [0, n). The new positions are added to bounds, so the tree's root box comes for free.
+// Each element gets the same arithmetic as axpy() for the kick followed by axpy() for the drift
+void kickDrift(size_t n, double kickDt, double driftDt, const double* ax, const double* ay,
+               double* vx, double* vy, double* x, double* y, Bounds& bounds);
+
+// Sum of 0.5 * mass[i] * (vx[i]² + vy[i]²)
+double sumKineticEnergy(size_t n, const double* vx, const double* vy, const double* mass);
+
+// Sum of mass[i] / sqrt(|(x[i], y[i]) - (px, py)|² + softening), the potential at (px, py)
+// over GC. softening is added to the squared distance as is
+double sumInverseDistance(size_t n, const double* x, const double* y, const double* mass,
+                          double px, double py, double softening);
+
+// Name of the instruction set the functions above run with
+const char* batchMathIsaName();
+
+#endif // BATCHMATH_H
@@ -0,0 +1,132 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include "Vec.h"
+
+// Collision detection and response for any dimension, shared by the 2D Simulation and
+// ParticleSystem
+
+// Calls onPair(i, j), i < j, for every pair of overlapping axis-aligned boxes among n.
+// lo[d][i] and hi[d][i] are the edges of box i on axis d, and the boxes must be sorted by
+// lo[0][i]: the sweep runs along axis 0 and the remaining axes are compared per pair
+template <size_t D, typename F>
+void sweepAndPrune(size_t n, const std::array<const double*, D>& lo, const std::array<const double*, D>& hi, F&& onPair) {
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i + 1; j < n; ++j) {
+
+            // THE MAGIC: If the next body's left edge is further right than our right edge,
+            // NO further bodies in the sorted list can possibly intersect with us. Break early!
+            if (lo[0][j] > hi[0][i]) {
+                break;
+            }
+
+            // Quick AABB check on the other axes before doing expensive square roots
+            bool overlap = true;
+            for (size_t d = 1; d < D; ++d) {
+                if (lo[d][i] > hi[d][j] || hi[d][i] < lo[d][j]) {
+                    overlap = false;
+                    break;
+                }
+            }
+
+            if (overlap) {
+                onPair(i, j);
+            }
+        }
+    }
+}
+
+// Pushes two overlapping spheres apart and applies a normal and a friction impulse.
+// Returns false, leaving everything untouched, when they do not overlap
+template <size_t D>
+bool resolveContact(Vec<D>& p1, Vec<D>& v1, double m1, double r1,
+                    Vec<D>& p2, Vec<D>& v2, double m2, double r2, double restitution) {
+    Vec<D> delta = p1 - p2;
+    double distSq = delta.magSqrd();
+    double radiusSum = r1 + r2;
+
+    // Check if they are overlapping
+    if (distSq >= radiusSum * radiusSum || distSq == 0.0) return false;
+
+    double dist = std::sqrt(distSq);
+    Vec<D> normal = delta / dist;
+
+    // Positional Correction (with "slop" and relaxation)
+    const double ALLOWED_PENETRATION = 0.01;
+    const double POSITIONAL_PERCENT = 0.8;
+
+    double overlap = radiusSum - dist;
+
+    if (overlap > ALLOWED_PENETRATION) {
+        double totalMass = m1 + m2;
+        double m1Ratio = m2 / totalMass;
+        double m2Ratio = m1 / totalMass;
+
+        // Multiply the correction by our new percentage
+        p1 = p1 + normal * (overlap * m1Ratio * POSITIONAL_PERCENT);
+        p2 = p2 - normal * (overlap * m2Ratio * POSITIONAL_PERCENT);
+    }
+
+    // Velocity Resolution (Normal Impulse)
+    Vec<D> relVel = v1 - v2;
+    double velAlongNormal = relVel.dot(normal);
+
+    // If velocities are separating, don't resolve
+    if (velAlongNormal > 0) return true;
+
+    // A higher threshold aggressively kills kinetic energy
+    // for objects caught in strong gravity wells.
+    const double RESTING_THRESHOLD = 1.0;
+
+    double actualRestitution = restitution;
+    if (std::abs(velAlongNormal) < RESTING_THRESHOLD) {
+        actualRestitution = 0.0; // Force a dead stop
+    }
+
+    double j = -(1.0 + actualRestitution) * velAlongNormal;
+    j /= (1.0 / m1 + 1.0 / m2);
+
+    Vec<D> normalImpulse = normal * j;
+
+    v1 = v1 + normalImpulse / m1;
+    v2 = v2 - normalImpulse / m2;
+
+    // Friction (Tangential Impulse)
+    // Recalculate relative velocity after the normal impulse was applied
+    Vec<D> newRelVel = v1 - v2;
+    Vec<D> tangent;
+    if constexpr (D == 2) {
+        // In 2D, the tangent is perpendicular to the normal. If normal is (x, y), tangent is (-y, x).
+        tangent = Vec<D>(-normal[1], normal[0]);
+    } else {
+        // Otherwise it is the direction the bodies slide along each other
+        tangent = (newRelVel - normal * newRelVel.dot(normal)).normalized();
+    }
+    double velAlongTangent = newRelVel.dot(tangent);
+
+    // Calculate the tangential impulse scalar
+    double jt = -velAlongTangent;
+    jt /= (1.0 / m1 + 1.0 / m2);
+
+    // Coulomb friction law: friction is proportional to the normal force (impulse)
+    const double FRICTION_COEFFICIENT = 0.5; // 0.0 = ice, 1.0+ = very sticky
+    double maxFriction = std::abs(j) * FRICTION_COEFFICIENT;
+
+    // Clamp the tangential impulse so it doesn't exceed static friction
+    if (jt > maxFriction) {
+        jt = maxFriction;
+    } else if (jt < -maxFriction) {
+        jt = -maxFriction;
+    }
+
+    Vec<D> frictionImpulse = tangent * jt;
+
+    // Apply friction impulse
+    v1 = v1 + frictionImpulse / m1;
+    v2 = v2 - frictionImpulse / m2;
+    return true;
+}
+
+#endif // COLLISION_H
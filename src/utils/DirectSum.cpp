@@ -0,0 +1,117 @@
+#include "DirectSum.h"
+#include <algorithm>
+#include "ForceKernel.h"
+#include "../headers/BodyStore.h"
+
+DirectSum::DirectSum(double epsilon) : m_epsilonsq(epsilon * epsilon) {
+}
+
+void DirectSum::load(const BodyStore& bodies) {
+    size_t n = bodies.size();
+    m_x.assign(bodies.x(), bodies.x() + n);
+    m_y.assign(bodies.y(), bodies.y() + n);
+    m_mass.assign(bodies.mass(), bodies.mass() + n);
+}
+
+void DirectSum::solve(BodyStore& bodies, ThreadPool& pool, std::vector<FrameArena>& arenas) {
+    load(bodies);
+    size_t n = m_x.size();
+    if (n == 0) return;
+
+    size_t tiles = (n + m_tileSize - 1) / m_tileSize;
+    size_t tilePairs = tiles * (tiles + 1) / 2;
+    size_t tasks = std::min(arenas.size(), tilePairs);
+    if (m_bufferX.size() < tasks) {
+        m_bufferX.resize(tasks);
+        m_bufferY.resize(tasks);
+    }
+
+    for (size_t t = 0; t < tasks; ++t) {
+        pool.enqueue([this, &arenas, t, tasks, n]() {
+            double* ax = arenas[t].alloc<double>(n);
+            double* ay = arenas[t].alloc<double>(n);
+            std::fill(ax, ax + n, 0.0);
+            std::fill(ay, ay + n, 0.0);
+            m_bufferX[t] = ax;
+            m_bufferY[t] = ay;
+            runTask(t, tasks, ax, ay);
+        });
+    }
+    pool.wait();
+
+    // Every task touched arbitrary bodies, so sum all buffers for each body
+    size_t bodiesPerTask = (n + tasks - 1) / tasks;
+    for (size_t t = 0; t < tasks; ++t) {
+        size_t start = t * bodiesPerTask;
+        size_t end = std::min(start + bodiesPerTask, n);
+        if (start >= n) break;
+
+        pool.enqueue([this, &bodies, start, end, tasks]() {
+            double* ax = bodies.ax();
+            double* ay = bodies.ay();
+            for (size_t i = start; i < end; ++i) {
+                ax[i] = 0.0;
+                ay[i] = 0.0;
+            }
+            for (size_t b = 0; b < tasks; ++b) {
+                const double* bufferX = m_bufferX[b];
+                const double* bufferY = m_bufferY[b];
+                for (size_t i = start; i < end; ++i) {
+                    ax[i] += bufferX[i];
+                    ay[i] += bufferY[i];
+                }
+            }
+        });
+    }
+    pool.wait();
+}
+
+void DirectSum::runTask(size_t task, size_t tasks, double* ax, double* ay) const {
+    size_t n = m_x.size();
+    size_t tiles = (n + m_tileSize - 1) / m_tileSize;
+    size_t blocks = (tiles + m_blockTiles - 1) / m_blockTiles;
+
+    // Weights in half pairs: a tile with itself is 1, two different tiles are 2
+    size_t totalWeight = tiles * tiles;
+    size_t shareFirst = totalWeight * task / tasks;
+    size_t shareLast = totalWeight * (task + 1) / tasks;
+
+    size_t weight = 0;
+    for (size_t a = 0; a < blocks; ++a) {
+        size_t aLast = std::min((a + 1) * m_blockTiles, tiles);
+        for (size_t b = a; b < blocks; ++b) {
+            size_t bLast = std::min((b + 1) * m_blockTiles, tiles);
+            for (size_t i = a * m_blockTiles; i < aLast; ++i) {
+                for (size_t j = (a == b ? i : b * m_blockTiles); j < bLast; ++j) {
+                    // A pair belongs to the share its first half pair falls into
+                    size_t pairWeight = i == j ? 1 : 2;
+                    bool mine = weight >= shareFirst && weight < shareLast;
+                    weight += pairWeight;
+                    if (!mine) continue;
+
+                    tilePair(i * m_tileSize, std::min((i + 1) * m_tileSize, n),
+                             j * m_tileSize, std::min((j + 1) * m_tileSize, n), ax, ay);
+                }
+            }
+        }
+    }
+}
+
+void DirectSum::tilePair(size_t first, size_t last, size_t sourceFirst, size_t sourceLast,
+                         double* ax, double* ay) const {
+    bool self = first == sourceFirst;
+    for (size_t i = first; i < last; ++i) {
+        size_t j = self ? i + 1 : sourceFirst;
+        if (j >= sourceLast) continue;
+
+        Vec2 acc = sumPointMassesSymmetric(&m_x[j], &m_y[j], &m_mass[j], sourceLast - j,
+                                           m_x[i], m_y[i], m_mass[i], ax + j, ay + j, m_epsilonsq);
+        ax[i] += acc.getX();
+        ay[i] += acc.getY();
+    }
+}
+
+Vec2 DirectSum::accAt(Vec2 pos) const {
+    return sumPointMasses(m_x.data(), m_y.data(), m_mass.data(), m_x.size(),
+                          pos.getX(), pos.getY(), m_epsilonsq);
+}
@@ -0,0 +1,56 @@
+#ifndef DIRECTSUM_H
+#define DIRECTSUM_H
+#include <vector>
+#include "Vec.h"
+#include "FrameArena.h"
+#include "../headers/ThreadPool.h"
+
+class BodyStore;
+
+// Exact O(N^2) softened gravity, used when the tree would open every node anyway (theta = 0)
+// or N is too small for the tree to pay off, and as the reference for accuracy measurements.
+// Bodies are split into L1-sized tiles grouped into L2-sized blocks, and tile pairs are
+// visited block pair by block pair. Each task takes a contiguous run of tile pairs; a body
+// pair is evaluated once and the reaction goes into the task's own buffer (Newton's third
+// law), then the buffers are summed per body.
+class DirectSum {
+private:
+    // Bodies per tile, so the source tile's positions, masses and reactions fit in L1
+    static constexpr size_t m_tileSize = 256;
+    // Tiles per block, so a block pair stays in L2 while its tiles are swept
+    static constexpr size_t m_blockTiles = 16;
+
+    double m_epsilonsq;
+
+    // Positions and masses copied at load(), so accAt() keeps working while the bodies move
+    std::vector<double> m_x;
+    std::vector<double> m_y;
+    std::vector<double> m_mass;
+
+    // One acceleration buffer per task, summed per body at the end. They live in the task's arena
+    std::vector<double*> m_bufferX;
+    std::vector<double*> m_bufferY;
+
+    // Interactions of sink bodies [first, last) with sources [sourceFirst, sourceLast), both ways.
+    // Sources at or before a sink are skipped when the ranges are the same
+    void tilePair(size_t first, size_t last, size_t sourceFirst, size_t sourceLast, double* ax, double* ay) const;
+
+    // Run task's share of the tile pairs, in block order. Shares are equal in work, a tile
+    // paired with itself counts as half a pair
+    void runTask(size_t task, size_t tasks, double* ax, double* ay) const;
+
+public:
+    DirectSum(double epsilon);
+
+    // Copy positions and masses of bodies, needed before solve() or accAt()
+    void load(const BodyStore& bodies);
+
+    // Set every body's acceleration to the exact sum over all other bodies. The tile pairs are
+    // split into one task per arena (at least one), each task's buffers come from its arena
+    void solve(BodyStore& bodies, ThreadPool& pool, std::vector<FrameArena>& arenas);
+
+    // Exact acceleration at a position from the loaded bodies, skipping any body sitting on it
+    Vec2 accAt(Vec2 pos) const;
+};
+
+#endif // DIRECTSUM_H
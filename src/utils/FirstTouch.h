@@ -0,0 +1,55 @@
+#ifndef FIRSTTOUCH_H
+#define FIRSTTOUCH_H
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include "../headers/ThreadPool.h"
+
+// Allocator whose resize() leaves new elements of trivial types unwritten. The operating
+// system puts a page on the NUMA node of the thread that first writes it, so leaving the
+// first write to the workers is what lets placeOnWorkers() decide where an array lives
+template <typename T>
+struct NoInitAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = NoInitAllocator<U>;
+    };
+
+    NoInitAllocator() = default;
+    template <typename U>
+    NoInitAllocator(const NoInitAllocator<U>&) noexcept {}
+
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+// Array of a per-body field, see placeOnWorkers()
+template <typename T>
+using FieldVector = std::vector<T, NoInitAllocator<T>>;
+
+// Move field into a new buffer first written by the pool's workers: slot s of a static
+// parallelFor over [0, size) with this grain copies its own range. With pinned workers, each
+// range's pages end up on the node of the worker that later loops over it with the same grain
+template <typename T>
+void placeOnWorkers(FieldVector<T>& field, ThreadPool& pool, size_t grain) {
+    static_assert(std::is_trivially_copyable<T>::value, "fields are copied into place as plain values");
+
+    FieldVector<T> placed;
+    placed.reserve(field.capacity());
+    placed.resize(field.size());
+    pool.parallelFor(0, field.size(), grain, [&](size_t first, size_t last, size_t) {
+        std::copy(field.begin() + first, field.begin() + last, placed.begin() + first);
+    });
+    field.swap(placed);
+}
+
+#endif // FIRSTTOUCH_H
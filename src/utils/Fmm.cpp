@@ -0,0 +1,388 @@
+#include "Fmm.h"
+#include <cmath>
+#include <algorithm>
+
+// Terms of total degree at most FMM_ORDER, as (a, b) exponent pairs in index order
+struct FmmTerm {
+    int a;
+    int b;
+};
+
+static const std::array<FmmTerm, FMM_TERMS> TERMS = [] {
+    std::array<FmmTerm, FMM_TERMS> terms{};
+    for (int n = 0; n <= FMM_ORDER; ++n) {
+        for (int b = 0; b <= n; ++b) {
+            terms[fmmIndex(n - b, b)] = {n - b, b};
+        }
+    }
+    return terms;
+}();
+
+// Every pair of terms n, k whose sum n + k is still within FMM_ORDER. All three translations
+// (multipole shift, multipole to local, local shift) are sums over this list
+struct FmmPair {
+    uint8_t n;
+    uint8_t k;
+    uint8_t sum;
+};
+
+static const std::vector<FmmPair> PAIRS = [] {
+    std::vector<FmmPair> pairs;
+    for (int n = 0; n < FMM_TERMS; ++n) {
+        for (int k = 0; k < FMM_TERMS; ++k) {
+            int a = TERMS[n].a + TERMS[k].a;
+            int b = TERMS[n].b + TERMS[k].b;
+            if (a + b <= FMM_ORDER) {
+                pairs.push_back({uint8_t(n), uint8_t(k), uint8_t(fmmIndex(a, b))});
+            }
+        }
+    }
+    return pairs;
+}();
+
+// x^a / a! and y^b / b! for every exponent up to FMM_ORDER
+static void scaledPowers(double x, double y, double* xp, double* yp) {
+    xp[0] = 1.0;
+    yp[0] = 1.0;
+    for (int k = 1; k <= FMM_ORDER; ++k) {
+        xp[k] = xp[k - 1] * x / k;
+        yp[k] = yp[k - 1] * y / k;
+    }
+}
+
+// Partial derivatives d^(a+b) / dx^a dy^b of the softened kernel 1/sqrt(x^2 + y^2 + eps^2),
+// from the Hermite recurrence R(n)[t+1] = t R(n+1)[t-1] + x R(n+1)[t]
+static void kernelDerivatives(double x, double y, double epsSq, FmmCoeffs& out) {
+    double r[FMM_ORDER + 1][FMM_TERMS];
+
+    double s = x * x + y * y + epsSq;
+    double invS = 1.0 / s;
+    r[0][0] = 1.0 / std::sqrt(s);
+    for (int n = 1; n <= FMM_ORDER; ++n) {
+        r[n][0] = -(2 * n - 1) * invS * r[n - 1][0];
+    }
+
+    for (int m = 1; m <= FMM_ORDER; ++m) {
+        for (int n = 0; n + m <= FMM_ORDER; ++n) {
+            for (int b = 0; b <= m; ++b) {
+                int a = m - b;
+                double value;
+                if (a > 0) {
+                    value = x * r[n + 1][fmmIndex(a - 1, b)];
+                    if (a > 1) value += (a - 1) * r[n + 1][fmmIndex(a - 2, b)];
+                } else {
+                    value = y * r[n + 1][fmmIndex(0, b - 1)];
+                    if (b > 1) value += (b - 1) * r[n + 1][fmmIndex(0, b - 2)];
+                }
+                r[n][fmmIndex(a, b)] = value;
+            }
+        }
+    }
+
+    for (int i = 0; i < FMM_TERMS; ++i) {
+        out[i] = r[0][i];
+    }
+}
+
+Fmm::Fmm(double theta, double epsilon)
+    : m_theta(theta), m_epsilonsq(epsilon * epsilon), m_splitDepth(3) {
+}
+
+void Fmm::solve(const Quadtree& tree, ThreadPool& pool, size_t chunks) {
+    m_tree = &tree;
+    const std::vector<Node>& nodes = tree.getNodes();
+    m_topNodes.clear();
+    m_taskCount = 0;
+    if (nodes.empty() || nodes[m_root].isEmpty()) return;
+
+    m_multipole.resize(nodes.size());
+    m_local.resize(nodes.size());
+    m_radius.resize(nodes.size());
+    m_near.resize(nodes.size());
+
+    // About four tasks per thread, so uneven subtrees still balance out
+    m_splitDepth = 1;
+    while (m_splitDepth < 6 && (size_t(1) << (2 * m_splitDepth)) < 4 * chunks) {
+        m_splitDepth++;
+    }
+
+    collectTasks(m_root, 0);
+
+    // 1. Upward pass: each task's subtree, then the few branches above them
+    for (uint32_t t = 0; t < m_taskCount; ++t) {
+        pool.enqueue([this, t]() {
+            upward(m_tasks[t].root);
+        });
+    }
+    pool.wait();
+
+    for (auto it = m_topNodes.rbegin(); it != m_topNodes.rend(); ++it) {
+        shiftMultipoles(*it);
+    }
+
+    // 2. Downward pass: every task walks its subtree against the whole tree. A task root's
+    // local expansion starts empty, so nothing above it is needed
+    for (uint32_t t = 0; t < m_taskCount; ++t) {
+        pool.enqueue([this, t]() {
+            Task& task = m_tasks[t];
+            task.lists.clear();
+            task.near.clear();
+            task.lists.push_back(m_root);
+            m_local[task.root].fill(0.0);
+            walk(t, task.root, 0, 1);
+        });
+    }
+    pool.wait();
+}
+
+void Fmm::collectTasks(uint32_t node, int depth) {
+    const std::vector<Node>& nodes = m_tree->getNodes();
+    const Node& n = nodes[node];
+    if (n.isEmpty()) {
+        m_near[node] = NearRange();
+        return;
+    }
+
+    if (n.isLeaf() || depth == m_splitDepth) {
+        if (m_taskCount == m_tasks.size()) {
+            m_tasks.emplace_back();
+        }
+        m_tasks[m_taskCount++].root = node;
+        return;
+    }
+
+    m_topNodes.push_back(node);
+    m_near[node] = NearRange();
+    for (uint32_t k = 0; k < 4; ++k) {
+        collectTasks(n.children + k, depth + 1);
+    }
+}
+
+void Fmm::upward(uint32_t node) {
+    const Node& n = m_tree->getNodes()[node];
+    m_near[node] = NearRange();
+    if (n.isEmpty()) return;
+
+    if (n.isLeaf()) {
+        leafMultipole(node);
+        return;
+    }
+
+    for (uint32_t k = 0; k < 4; ++k) {
+        upward(n.children + k);
+    }
+    shiftMultipoles(node);
+}
+
+void Fmm::leafMultipole(uint32_t node) {
+    const Node& leaf = m_tree->getNodes()[node];
+    FmmCoeffs& m = m_multipole[node];
+    m.fill(0.0);
+
+    if (!leaf.isBucket()) {
+        // Every body of a plain leaf sits at its center of mass
+        m[0] = leaf.mass;
+        m_radius[node] = 0.0;
+        return;
+    }
+
+    const std::vector<Vec2>& pos = m_tree->getSortedPositions();
+    const FieldVector<double>& mass = m_tree->getSortedMasses();
+    uint32_t first = leaf.children & ~Node::LEAF_BUCKET;
+    uint32_t last = first + m_tree->getCells()[node].count;
+
+    double radiusSq = 0.0;
+    double xp[FMM_ORDER + 1];
+    double yp[FMM_ORDER + 1];
+    for (uint32_t i = first; i < last; ++i) {
+        double dx = pos[i].getX() - leaf.x;
+        double dy = pos[i].getY() - leaf.y;
+        radiusSq = std::max(radiusSq, dx * dx + dy * dy);
+
+        scaledPowers(dx, dy, xp, yp);
+        for (int k = 0; k < FMM_TERMS; ++k) {
+            m[k] += mass[i] * xp[TERMS[k].a] * yp[TERMS[k].b];
+        }
+    }
+    m_radius[node] = std::sqrt(radiusSq);
+}
+
+void Fmm::shiftMultipoles(uint32_t node) {
+    const std::vector<Node>& nodes = m_tree->getNodes();
+    const Node& parent = nodes[node];
+    FmmCoeffs& m = m_multipole[node];
+    m.fill(0.0);
+
+    double radius = 0.0;
+    double xp[FMM_ORDER + 1];
+    double yp[FMM_ORDER + 1];
+    for (uint32_t k = 0; k < 4; ++k) {
+        uint32_t c = parent.children + k;
+        const Node& child = nodes[c];
+        if (child.isEmpty()) continue;
+
+        double dx = child.x - parent.x;
+        double dy = child.y - parent.y;
+        radius = std::max(radius, std::sqrt(dx * dx + dy * dy) + m_radius[c]);
+
+        // M[n + k] += Mc[n] * dx^ka/ka! * dy^kb/kb!
+        scaledPowers(dx, dy, xp, yp);
+        const FmmCoeffs& mc = m_multipole[c];
+        for (const FmmPair& p : PAIRS) {
+            m[p.sum] += mc[p.n] * xp[TERMS[p.k].a] * yp[TERMS[p.k].b];
+        }
+    }
+    m_radius[node] = radius;
+}
+
+void Fmm::multipoleToLocal(uint32_t source, uint32_t sink) {
+    const std::vector<Node>& nodes = m_tree->getNodes();
+    const Node& a = nodes[source];
+    const Node& b = nodes[sink];
+
+    FmmCoeffs d;
+    kernelDerivatives(b.x - a.x, b.y - a.y, m_epsilonsq, d);
+
+    // L[n] -= G * sum over k of (-1)^|k| * D[n + k] * M[k]
+    const FmmCoeffs& m = m_multipole[source];
+    FmmCoeffs signedM;
+    for (int k = 0; k < FMM_TERMS; ++k) {
+        signedM[k] = ((TERMS[k].a + TERMS[k].b) % 2 == 0) ? -GC * m[k] : GC * m[k];
+    }
+
+    FmmCoeffs& l = m_local[sink];
+    for (const FmmPair& p : PAIRS) {
+        l[p.n] += d[p.sum] * signedM[p.k];
+    }
+}
+
+void Fmm::shiftLocal(uint32_t parent, uint32_t child) {
+    const std::vector<Node>& nodes = m_tree->getNodes();
+    double xp[FMM_ORDER + 1];
+    double yp[FMM_ORDER + 1];
+    scaledPowers(nodes[child].x - nodes[parent].x, nodes[child].y - nodes[parent].y, xp, yp);
+
+    // Lc[n] = sum over k of L[n + k] * dx^ka/ka! * dy^kb/kb!
+    const FmmCoeffs& l = m_local[parent];
+    FmmCoeffs& lc = m_local[child];
+    lc.fill(0.0);
+    for (const FmmPair& p : PAIRS) {
+        lc[p.n] += l[p.sum] * xp[TERMS[p.k].a] * yp[TERMS[p.k].b];
+    }
+}
+
+void Fmm::walk(uint32_t taskIndex, uint32_t sink, size_t first, size_t last) {
+    const std::vector<Node>& nodes = m_tree->getNodes();
+    Task& task = m_tasks[taskIndex];
+    const Node& b = nodes[sink];
+    double thetaSq = m_theta * m_theta;
+
+    // Sources the sink's children have to look at again
+    size_t keepFirst = task.lists.size();
+    size_t nearFirst = task.near.size();
+
+    task.work.assign(task.lists.begin() + first, task.lists.begin() + last);
+    while (!task.work.empty()) {
+        uint32_t source = task.work.back();
+        task.work.pop_back();
+
+        const Node& a = nodes[source];
+        if (a.isEmpty()) continue;
+
+        double dx = b.x - a.x;
+        double dy = b.y - a.y;
+        double reach = m_radius[source] + m_radius[sink];
+        if (reach * reach < thetaSq * (dx * dx + dy * dy)) {
+            multipoleToLocal(source, sink);
+        } else if (b.isLeaf()) {
+            if (a.isLeaf()) {
+                task.near.push_back(source);
+            } else {
+                for (uint32_t k = 0; k < 4; ++k) task.work.push_back(a.children + k);
+            }
+        } else if (a.isLeaf() || m_radius[source] <= m_radius[sink]) {
+            // Open the sink instead
+            task.lists.push_back(source);
+        } else {
+            for (uint32_t k = 0; k < 4; ++k) task.work.push_back(a.children + k);
+        }
+    }
+
+    if (b.isLeaf()) {
+        NearRange& range = m_near[sink];
+        range.task = taskIndex;
+        range.first = static_cast<uint32_t>(nearFirst);
+        range.count = static_cast<uint32_t>(task.near.size() - nearFirst);
+        return;
+    }
+
+    size_t keepLast = task.lists.size();
+    for (uint32_t k = 0; k < 4; ++k) {
+        uint32_t child = b.children + k;
+        if (nodes[child].isEmpty()) continue;
+        shiftLocal(sink, child);
+        walk(taskIndex, child, keepFirst, keepLast);
+    }
+    task.lists.resize(keepFirst);
+}
+
+inline void Fmm::addPointMass(Vec2& acceleration, Vec2 d, double mass) const {
+    ::addPointMass(acceleration, d, mass, m_epsilonsq);
+}
+
+Vec2 Fmm::acc(Vec2 pos) const {
+    if (m_tree == nullptr || m_taskCount == 0) return Vec2(0, 0);
+
+    const std::vector<Node>& nodes = m_tree->getNodes();
+    const std::vector<Cell>& cells = m_tree->getCells();
+
+    // Descend to the leaf holding pos, the same way the builders placed it
+    uint32_t node = m_root;
+    while (nodes[node].isBranch()) {
+        node = nodes[node].children + static_cast<uint32_t>(cells[node].quad.findQuadrant(pos));
+    }
+
+    // A body sitting exactly on a cell edge can land in a leaf the walk never reached
+    const NearRange& range = m_near[node];
+    if (range.task == m_noTask) {
+        return m_tree->acc(pos);
+    }
+
+    // Far field: a = -grad of the local expansion at offset u from the leaf's center of mass
+    const Node& leaf = nodes[node];
+    const FmmCoeffs& l = m_local[node];
+    double xp[FMM_ORDER + 1];
+    double yp[FMM_ORDER + 1];
+    scaledPowers(pos.getX() - leaf.x, pos.getY() - leaf.y, xp, yp);
+
+    double ax = 0.0;
+    double ay = 0.0;
+    for (int t = 0; t < FMM_TERMS; ++t) {
+        int a = TERMS[t].a;
+        int b = TERMS[t].b;
+        if (a + b == FMM_ORDER) break;
+        double u = xp[a] * yp[b];
+        ax -= l[fmmIndex(a + 1, b)] * u;
+        ay -= l[fmmIndex(a, b + 1)] * u;
+    }
+    Vec2 acceleration(ax, ay);
+
+    // Near field: direct sum over the bodies of every leaf too close to expand
+    const std::vector<Vec2>& sortedPos = m_tree->getSortedPositions();
+    const FieldVector<double>& sortedMass = m_tree->getSortedMasses();
+    const std::vector<uint32_t>& near = m_tasks[range.task].near;
+    for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+        const Node& source = nodes[near[i]];
+        if (source.isBucket()) {
+            uint32_t first = source.children & ~Node::LEAF_BUCKET;
+            uint32_t last = first + cells[near[i]].count;
+            for (uint32_t j = first; j < last; ++j) {
+                addPointMass(acceleration, sortedPos[j] - pos, sortedMass[j]);
+            }
+        } else {
+            addPointMass(acceleration, source.getPos() - pos, source.mass);
+        }
+    }
+
+    return acceleration;
+}
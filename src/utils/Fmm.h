@@ -0,0 +1,98 @@
+#ifndef FMM_H
+#define FMM_H
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include "Vec.h"
+#include "QuadTree.h"
+#include "../headers/ThreadPool.h"
+
+// Highest total degree kept in the multipole and local expansions
+constexpr int FMM_ORDER = 4;
+constexpr int FMM_TERMS = (FMM_ORDER + 1) * (FMM_ORDER + 2) / 2;
+
+// Coefficients of a 2D Cartesian expansion, the x^a y^b term lives at fmmIndex(a, b)
+using FmmCoeffs = std::array<double, FMM_TERMS>;
+
+constexpr int fmmIndex(int a, int b) { return (a + b) * (a + b + 1) / 2 + b; }
+
+// Fast multipole solver running on the nodes of an already propagated Quadtree.
+// Every occupied node gets a multipole expansion about its center of mass (upward pass),
+// then a dual tree walk turns well separated node pairs into local expansions and
+// collects the remaining leaf pairs as near-field lists (downward pass). Both passes are
+// split into subtrees run on the thread pool. acc() then only evaluates a leaf's local
+// expansion plus its near-field bodies.
+class Fmm {
+private:
+    // Near-field source leaves of a sink leaf, stored in one task's list
+    struct NearRange {
+        uint32_t task = m_noTask;
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    // One subtree of the walk with its scratch lists, kept between solves
+    struct Task {
+        uint32_t root = 0;
+        std::vector<uint32_t> lists;    // Source candidates, one segment per open level of the walk
+        std::vector<uint32_t> work;     // Sources still to test against the current sink
+        std::vector<uint32_t> near;     // Near-field sources, contiguous per sink leaf
+    };
+
+    static constexpr uint32_t m_root = 0;
+    static constexpr uint32_t m_noTask = std::numeric_limits<uint32_t>::max();
+
+    const Quadtree* m_tree = nullptr;
+    double m_theta;         // Opening parameter, nodes interact through expansions when (rA + rB) < theta * d
+    double m_epsilonsq;     // Softening, same as the tree walk
+    int m_splitDepth;       // Depth at which the tree is cut into tasks
+
+    std::vector<FmmCoeffs> m_multipole;
+    std::vector<FmmCoeffs> m_local;
+    std::vector<double> m_radius;       // Distance from a node's center of mass to its farthest body
+    std::vector<NearRange> m_near;
+
+    std::vector<uint32_t> m_topNodes;   // Branches above the task roots, in pre-order
+    std::vector<Task> m_tasks;          // Only the first m_taskCount are used by the current solve
+    size_t m_taskCount = 0;
+
+    // Split the tree into task roots and the branches above them
+    void collectTasks(uint32_t node, int depth);
+
+    // Multipoles of node's whole subtree, children first
+    void upward(uint32_t node);
+
+    // Multipole of a leaf from its bodies
+    void leafMultipole(uint32_t node);
+
+    // Multipole of a branch by shifting its children's to its center of mass
+    void shiftMultipoles(uint32_t node);
+
+    // Add source's multipole to sink's local expansion
+    void multipoleToLocal(uint32_t source, uint32_t sink);
+
+    // Set child's local expansion to its parent's shifted to the child's center of mass
+    void shiftLocal(uint32_t parent, uint32_t child);
+
+    // Walk sink against the sources in task.lists[first, last), recursing into sink's children
+    void walk(uint32_t taskIndex, uint32_t sink, size_t first, size_t last);
+
+    // Add the softened pull of a point mass at offset d
+    void addPointMass(Vec2& acceleration, Vec2 d, double mass) const;
+
+public:
+    Fmm(double theta, double epsilon);
+
+    // Build expansions and near-field lists for tree, which must stay alive and unchanged
+    // until the next solve. chunks is the thread count the task split is sized for
+    void solve(const Quadtree& tree, ThreadPool& pool, size_t chunks);
+
+    // Acceleration at the position of a body held by the solved tree
+    Vec2 acc(Vec2 pos) const;
+
+    double getTheta() const { return m_theta; }
+    void setTheta(double theta) { m_theta = theta; }
+};
+
+#endif // FMM_H
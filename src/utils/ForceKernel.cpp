@@ -0,0 +1,404 @@
+#include "ForceKernel.h"
+#include <cmath>
+#include <algorithm>
+#include "constants.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FORCE_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+// Largest acceleration magnitude per unit offset a single interaction may contribute
+static const double FORCE_CAP = 1e10;
+
+using PointMassKernel = Vec2 (*)(const double*, const double*, const double*, size_t, double, double, double);
+using PointMassKernelFloat = Vec2 (*)(const float*, const float*, const float*, size_t, float, float, float);
+using SymmetricKernel = Vec2 (*)(const double*, const double*, const double*, size_t, double, double, double,
+                                 double*, double*, double);
+
+static Vec2 sumScalar(const double* x, const double* y, const double* mass, size_t n,
+                      double px, double py, double epsilonSq) {
+    double ax = 0.0;
+    double ay = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double dx = x[i] - px;
+        double dy = y[i] - py;
+        double d_sq = dx * dx + dy * dy;
+
+        // Skip the body itself
+        if (d_sq > epsilonSq) {
+            double r_sq = d_sq + epsilonSq;
+            double forceMag = std::min(GC * mass[i] / (r_sq * std::sqrt(r_sq)), FORCE_CAP);
+            ax += dx * forceMag;
+            ay += dy * forceMag;
+        }
+    }
+    return Vec2(ax, ay);
+}
+
+static Vec2 sumScalarFloat(const float* x, const float* y, const float* mass, size_t n,
+                           float px, float py, float epsilonSq) {
+    const float g = static_cast<float>(GC);
+    const float cap = static_cast<float>(FORCE_CAP);
+    float ax = 0.0f;
+    float ay = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float dx = x[i] - px;
+        float dy = y[i] - py;
+        float d_sq = dx * dx + dy * dy;
+
+        if (d_sq > epsilonSq) {
+            float r_sq = d_sq + epsilonSq;
+            float forceMag = std::min(g * mass[i] / (r_sq * std::sqrt(r_sq)), cap);
+            ax += dx * forceMag;
+            ay += dy * forceMag;
+        }
+    }
+    return Vec2(ax, ay);
+}
+
+static Vec2 sumSymmetricScalar(const double* x, const double* y, const double* mass, size_t n,
+                               double px, double py, double pm, double* ax, double* ay, double epsilonSq) {
+    double sumX = 0.0;
+    double sumY = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double dx = x[i] - px;
+        double dy = y[i] - py;
+        double d_sq = dx * dx + dy * dy;
+
+        if (d_sq > epsilonSq) {
+            double r_sq = d_sq + epsilonSq;
+            double inv = 1.0 / (r_sq * std::sqrt(r_sq));
+            double forceMag = std::min(GC * mass[i] * inv, FORCE_CAP);
+            double reactionMag = std::min(GC * pm * inv, FORCE_CAP);
+            sumX += dx * forceMag;
+            sumY += dy * forceMag;
+            ax[i] -= dx * reactionMag;
+            ay[i] -= dy * reactionMag;
+        }
+    }
+    return Vec2(sumX, sumY);
+}
+
+#ifdef FORCE_KERNEL_X86
+
+__attribute__((target("avx2,fma")))
+static Vec2 sumAvx2(const double* x, const double* y, const double* mass, size_t n,
+                    double px, double py, double epsilonSq) {
+    const __m256d pxv = _mm256_set1_pd(px);
+    const __m256d pyv = _mm256_set1_pd(py);
+    const __m256d eps = _mm256_set1_pd(epsilonSq);
+    const __m256d g = _mm256_set1_pd(GC);
+    const __m256d cap = _mm256_set1_pd(FORCE_CAP);
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d ax = _mm256_setzero_pd();
+    __m256d ay = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), pxv);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i), pyv);
+        __m256d dSq = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+        __m256d near = _mm256_cmp_pd(dSq, eps, _CMP_GT_OQ);
+
+        __m256d rSq = _mm256_add_pd(dSq, eps);
+        __m256d inv = _mm256_div_pd(one, _mm256_mul_pd(rSq, _mm256_sqrt_pd(rSq)));
+        __m256d force = _mm256_min_pd(_mm256_mul_pd(_mm256_mul_pd(g, _mm256_loadu_pd(mass + i)), inv), cap);
+        force = _mm256_and_pd(force, near);
+
+        ax = _mm256_fmadd_pd(dx, force, ax);
+        ay = _mm256_fmadd_pd(dy, force, ay);
+    }
+
+    // Unaligned stores, MinGW does not keep the stack 32-byte aligned for alignas(32) locals
+    double lanesX[4];
+    double lanesY[4];
+    _mm256_storeu_pd(lanesX, ax);
+    _mm256_storeu_pd(lanesY, ay);
+    Vec2 tail = sumScalar(x + i, y + i, mass + i, n - i, px, py, epsilonSq);
+    return Vec2((lanesX[0] + lanesX[1]) + (lanesX[2] + lanesX[3]) + tail.getX(),
+                (lanesY[0] + lanesY[1]) + (lanesY[2] + lanesY[3]) + tail.getY());
+}
+
+__attribute__((target("avx2,fma")))
+static Vec2 sumSymmetricAvx2(const double* x, const double* y, const double* mass, size_t n,
+                             double px, double py, double pm, double* ax, double* ay, double epsilonSq) {
+    const __m256d pxv = _mm256_set1_pd(px);
+    const __m256d pyv = _mm256_set1_pd(py);
+    const __m256d eps = _mm256_set1_pd(epsilonSq);
+    const __m256d g = _mm256_set1_pd(GC);
+    const __m256d gpm = _mm256_set1_pd(GC * pm);
+    const __m256d cap = _mm256_set1_pd(FORCE_CAP);
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d sumX = _mm256_setzero_pd();
+    __m256d sumY = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), pxv);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i), pyv);
+        __m256d dSq = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+        __m256d near = _mm256_cmp_pd(dSq, eps, _CMP_GT_OQ);
+
+        __m256d rSq = _mm256_add_pd(dSq, eps);
+        __m256d inv = _mm256_div_pd(one, _mm256_mul_pd(rSq, _mm256_sqrt_pd(rSq)));
+        __m256d force = _mm256_min_pd(_mm256_mul_pd(_mm256_mul_pd(g, _mm256_loadu_pd(mass + i)), inv), cap);
+        __m256d reaction = _mm256_min_pd(_mm256_mul_pd(gpm, inv), cap);
+        force = _mm256_and_pd(force, near);
+        reaction = _mm256_and_pd(reaction, near);
+
+        sumX = _mm256_fmadd_pd(dx, force, sumX);
+        sumY = _mm256_fmadd_pd(dy, force, sumY);
+        _mm256_storeu_pd(ax + i, _mm256_fnmadd_pd(dx, reaction, _mm256_loadu_pd(ax + i)));
+        _mm256_storeu_pd(ay + i, _mm256_fnmadd_pd(dy, reaction, _mm256_loadu_pd(ay + i)));
+    }
+
+    // Unaligned stores, as in sumAvx2
+    double lanesX[4];
+    double lanesY[4];
+    _mm256_storeu_pd(lanesX, sumX);
+    _mm256_storeu_pd(lanesY, sumY);
+    Vec2 tail = sumSymmetricScalar(x + i, y + i, mass + i, n - i, px, py, pm, ax + i, ay + i, epsilonSq);
+    return Vec2((lanesX[0] + lanesX[1]) + (lanesX[2] + lanesX[3]) + tail.getX(),
+                (lanesY[0] + lanesY[1]) + (lanesY[2] + lanesY[3]) + tail.getY());
+}
+
+// GCC 12's AVX-512 intrinsics trip -Wuninitialized on their own placeholder operands
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx2,fma")))
+static Vec2 sumAvx2Float(const float* x, const float* y, const float* mass, size_t n,
+                         float px, float py, float epsilonSq) {
+    const __m256 pxv = _mm256_set1_ps(px);
+    const __m256 pyv = _mm256_set1_ps(py);
+    const __m256 eps = _mm256_set1_ps(epsilonSq);
+    const __m256 g = _mm256_set1_ps(static_cast<float>(GC));
+    const __m256 cap = _mm256_set1_ps(static_cast<float>(FORCE_CAP));
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 ax = _mm256_setzero_ps();
+    __m256 ay = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), pxv);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), pyv);
+        __m256 dSq = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+        __m256 near = _mm256_cmp_ps(dSq, eps, _CMP_GT_OQ);
+
+        __m256 rSq = _mm256_add_ps(dSq, eps);
+        __m256 inv = _mm256_div_ps(one, _mm256_mul_ps(rSq, _mm256_sqrt_ps(rSq)));
+        __m256 force = _mm256_min_ps(_mm256_mul_ps(_mm256_mul_ps(g, _mm256_loadu_ps(mass + i)), inv), cap);
+        force = _mm256_and_ps(force, near);
+
+        ax = _mm256_fmadd_ps(dx, force, ax);
+        ay = _mm256_fmadd_ps(dy, force, ay);
+    }
+
+    // Unaligned stores, as in sumAvx2
+    float lanesX[8];
+    float lanesY[8];
+    _mm256_storeu_ps(lanesX, ax);
+    _mm256_storeu_ps(lanesY, ay);
+    double sumX = 0.0;
+    double sumY = 0.0;
+    for (int k = 0; k < 8; ++k) {
+        sumX += lanesX[k];
+        sumY += lanesY[k];
+    }
+    Vec2 tail = sumScalarFloat(x + i, y + i, mass + i, n - i, px, py, epsilonSq);
+    return Vec2(sumX + tail.getX(), sumY + tail.getY());
+}
+
+__attribute__((target("avx512f")))
+static Vec2 sumAvx512(const double* x, const double* y, const double* mass, size_t n,
+                      double px, double py, double epsilonSq) {
+    const __m512d pxv = _mm512_set1_pd(px);
+    const __m512d pyv = _mm512_set1_pd(py);
+    const __m512d eps = _mm512_set1_pd(epsilonSq);
+    const __m512d g = _mm512_set1_pd(GC);
+    const __m512d cap = _mm512_set1_pd(FORCE_CAP);
+    const __m512d one = _mm512_set1_pd(1.0);
+    __m512d ax = _mm512_setzero_pd();
+    __m512d ay = _mm512_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(x + i), pxv);
+        __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(y + i), pyv);
+        __m512d dSq = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+        __mmask8 near = _mm512_cmp_pd_mask(dSq, eps, _CMP_GT_OQ);
+
+        __m512d rSq = _mm512_add_pd(dSq, eps);
+        __m512d inv = _mm512_div_pd(one, _mm512_mul_pd(rSq, _mm512_sqrt_pd(rSq)));
+        __m512d force = _mm512_min_pd(_mm512_mul_pd(_mm512_mul_pd(g, _mm512_loadu_pd(mass + i)), inv), cap);
+        force = _mm512_maskz_mov_pd(near, force);
+
+        ax = _mm512_fmadd_pd(dx, force, ax);
+        ay = _mm512_fmadd_pd(dy, force, ay);
+    }
+
+    Vec2 tail = sumScalar(x + i, y + i, mass + i, n - i, px, py, epsilonSq);
+    return Vec2(_mm512_reduce_add_pd(ax) + tail.getX(), _mm512_reduce_add_pd(ay) + tail.getY());
+}
+
+__attribute__((target("avx512f")))
+static Vec2 sumAvx512Float(const float* x, const float* y, const float* mass, size_t n,
+                           float px, float py, float epsilonSq) {
+    const __m512 pxv = _mm512_set1_ps(px);
+    const __m512 pyv = _mm512_set1_ps(py);
+    const __m512 eps = _mm512_set1_ps(epsilonSq);
+    const __m512 g = _mm512_set1_ps(static_cast<float>(GC));
+    const __m512 cap = _mm512_set1_ps(static_cast<float>(FORCE_CAP));
+    const __m512 one = _mm512_set1_ps(1.0f);
+    __m512 ax = _mm512_setzero_ps();
+    __m512 ay = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + i), pxv);
+        __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + i), pyv);
+        __m512 dSq = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+        __mmask16 near = _mm512_cmp_ps_mask(dSq, eps, _CMP_GT_OQ);
+
+        __m512 rSq = _mm512_add_ps(dSq, eps);
+        __m512 inv = _mm512_div_ps(one, _mm512_mul_ps(rSq, _mm512_sqrt_ps(rSq)));
+        __m512 force = _mm512_min_ps(_mm512_mul_ps(_mm512_mul_ps(g, _mm512_loadu_ps(mass + i)), inv), cap);
+        force = _mm512_maskz_mov_ps(near, force);
+
+        ax = _mm512_fmadd_ps(dx, force, ax);
+        ay = _mm512_fmadd_ps(dy, force, ay);
+    }
+
+    Vec2 tail = sumScalarFloat(x + i, y + i, mass + i, n - i, px, py, epsilonSq);
+    return Vec2(static_cast<double>(_mm512_reduce_add_ps(ax)) + tail.getX(),
+                static_cast<double>(_mm512_reduce_add_ps(ay)) + tail.getY());
+}
+
+__attribute__((target("avx512f")))
+static Vec2 sumSymmetricAvx512(const double* x, const double* y, const double* mass, size_t n,
+                               double px, double py, double pm, double* ax, double* ay, double epsilonSq) {
+    const __m512d pxv = _mm512_set1_pd(px);
+    const __m512d pyv = _mm512_set1_pd(py);
+    const __m512d eps = _mm512_set1_pd(epsilonSq);
+    const __m512d g = _mm512_set1_pd(GC);
+    const __m512d gpm = _mm512_set1_pd(GC * pm);
+    const __m512d cap = _mm512_set1_pd(FORCE_CAP);
+    const __m512d one = _mm512_set1_pd(1.0);
+    __m512d sumX = _mm512_setzero_pd();
+    __m512d sumY = _mm512_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(x + i), pxv);
+        __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(y + i), pyv);
+        __m512d dSq = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+        __mmask8 near = _mm512_cmp_pd_mask(dSq, eps, _CMP_GT_OQ);
+
+        __m512d rSq = _mm512_add_pd(dSq, eps);
+        __m512d inv = _mm512_div_pd(one, _mm512_mul_pd(rSq, _mm512_sqrt_pd(rSq)));
+        __m512d force = _mm512_min_pd(_mm512_mul_pd(_mm512_mul_pd(g, _mm512_loadu_pd(mass + i)), inv), cap);
+        __m512d reaction = _mm512_min_pd(_mm512_mul_pd(gpm, inv), cap);
+        force = _mm512_maskz_mov_pd(near, force);
+        reaction = _mm512_maskz_mov_pd(near, reaction);
+
+        sumX = _mm512_fmadd_pd(dx, force, sumX);
+        sumY = _mm512_fmadd_pd(dy, force, sumY);
+        _mm512_storeu_pd(ax + i, _mm512_fnmadd_pd(dx, reaction, _mm512_loadu_pd(ax + i)));
+        _mm512_storeu_pd(ay + i, _mm512_fnmadd_pd(dy, reaction, _mm512_loadu_pd(ay + i)));
+    }
+
+    Vec2 tail = sumSymmetricScalar(x + i, y + i, mass + i, n - i, px, py, pm, ax + i, ay + i, epsilonSq);
+    return Vec2(_mm512_reduce_add_pd(sumX) + tail.getX(), _mm512_reduce_add_pd(sumY) + tail.getY());
+}
+
+#pragma GCC diagnostic pop
+
+#endif // FORCE_KERNEL_X86
+
+static PointMassKernel kernelFor(ForceIsa isa) {
+#ifdef FORCE_KERNEL_X86
+    if (isa == ForceIsa::Avx512) return sumAvx512;
+    if (isa == ForceIsa::Avx2) return sumAvx2;
+#endif
+    return sumScalar;
+}
+
+static PointMassKernelFloat floatKernelFor(ForceIsa isa) {
+#ifdef FORCE_KERNEL_X86
+    if (isa == ForceIsa::Avx512) return sumAvx512Float;
+    if (isa == ForceIsa::Avx2) return sumAvx2Float;
+#endif
+    return sumScalarFloat;
+}
+
+static SymmetricKernel symmetricKernelFor(ForceIsa isa) {
+#ifdef FORCE_KERNEL_X86
+    if (isa == ForceIsa::Avx512) return sumSymmetricAvx512;
+    if (isa == ForceIsa::Avx2) return sumSymmetricAvx2;
+#endif
+    return sumSymmetricScalar;
+}
+
+static ForceIsa g_forceIsa = bestForceIsa();
+static PointMassKernel g_kernel = kernelFor(g_forceIsa);
+static PointMassKernelFloat g_kernelFloat = floatKernelFor(g_forceIsa);
+static SymmetricKernel g_symmetricKernel = symmetricKernelFor(g_forceIsa);
+
+Vec2 sumPointMasses(const double* x, const double* y, const double* mass, size_t n,
+                    double px, double py, double epsilonSq) {
+    return g_kernel(x, y, mass, n, px, py, epsilonSq);
+}
+
+Vec2 sumPointMassesFloat(const float* x, const float* y, const float* mass, size_t n,
+                         float px, float py, float epsilonSq) {
+    return g_kernelFloat(x, y, mass, n, px, py, epsilonSq);
+}
+
+Vec2 sumPointMassesSymmetric(const double* x, const double* y, const double* mass, size_t n,
+                             double px, double py, double pm, double* ax, double* ay, double epsilonSq) {
+    return g_symmetricKernel(x, y, mass, n, px, py, pm, ax, ay, epsilonSq);
+}
+
+bool forceIsaSupported(ForceIsa isa) {
+#ifdef FORCE_KERNEL_X86
+    // May run from a static initializer, before the runtime has probed the CPU
+    __builtin_cpu_init();
+#endif
+    switch (isa) {
+#ifdef FORCE_KERNEL_X86
+        case ForceIsa::Avx512: return __builtin_cpu_supports("avx512f");
+        case ForceIsa::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        case ForceIsa::Scalar: return true;
+        default: return false;
+    }
+}
+
+ForceIsa bestForceIsa() {
+    if (forceIsaSupported(ForceIsa::Avx512)) return ForceIsa::Avx512;
+    if (forceIsaSupported(ForceIsa::Avx2)) return ForceIsa::Avx2;
+    return ForceIsa::Scalar;
+}
+
+bool setForceIsa(ForceIsa isa) {
+    if (!forceIsaSupported(isa)) return false;
+    g_forceIsa = isa;
+    g_kernel = kernelFor(isa);
+    g_kernelFloat = floatKernelFor(isa);
+    g_symmetricKernel = symmetricKernelFor(isa);
+    return true;
+}
+
+ForceIsa getForceIsa() {
+    return g_forceIsa;
+}
+
+const char* forceIsaName(ForceIsa isa) {
+    switch (isa) {
+        case ForceIsa::Avx2: return "AVX2";
+        case ForceIsa::Avx512: return "AVX512";
+        default: return "Scalar";
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef FORCEKERNEL_H
+#define FORCEKERNEL_H
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include "Vec.h"
+#include "constants.h"
+
+// Batched evaluation of point-mass interactions for the force phase.
+// The tree walks only collect (x, y, mass) triples; these kernels sum them for one body
+// several interactions at a time. Every variant gives the same result as
+// addPointMass below up to summation order.
+
+// Add the softened pull of a point mass at offset d, skipping points closer than the softening
+// (the body itself). Shared by the Quadtree, Fmm and Orthtree walks, for Vec2 or Vec<D>
+template <typename V>
+inline void addPointMass(V& acceleration, const V& d, double mass, double epsilonSq) {
+    double d_sq = d.magSqrd();
+    if (d_sq > epsilonSq) {
+        double denom = (d_sq + epsilonSq) * std::sqrt(d_sq + epsilonSq);
+        double forceMag = std::min(GC * mass / denom, 1e10);
+        acceleration += d * forceMag;
+    }
+}
+
+// Barnes-Hut opening test shared by Quadtree and Orthtree: whether a cell of squared size sizeSq
+// and mass at squared distance d_sq may be used as one mass. accTolerance > 0 selects the
+// relative accuracy criterion, otherwise the cell has to be smaller than theta times the distance
+inline bool isFarCell(double sizeSq, double mass, double d_sq, double thetaSq, double accTolerance) {
+    if (accTolerance > 0.0) {
+        // The sink has to be outside the cell before the error estimate means anything
+        return sizeSq < d_sq && GC * mass * sizeSq < accTolerance * d_sq * d_sq;
+    }
+    return sizeSq < d_sq * thetaSq;
+}
+
+// Instruction sets a kernel exists for
+enum class ForceIsa {
+    Scalar,
+    Avx2,   // 4 doubles per lane, needs AVX2 + FMA
+    Avx512  // 8 doubles per lane, needs AVX-512F
+};
+
+// Softened acceleration at (px, py) from n point masses, skipping points closer than the softening
+Vec2 sumPointMasses(const double* x, const double* y, const double* mass, size_t n,
+                    double px, double py, double epsilonSq);
+
+// Single precision version for far-field interactions, twice as many per lane. Positions are
+// offsets from a common origin so they stay small enough for float; the sum is returned in double
+Vec2 sumPointMassesFloat(const float* x, const float* y, const float* mass, size_t n,
+                         float px, float py, float epsilonSq);
+
+// Symmetric version for direct summation: returns the acceleration at (px, py) like
+// sumPointMasses, and also subtracts the pull of a mass pm at (px, py) on every point from
+// ax/ay, so each pair is evaluated once
+Vec2 sumPointMassesSymmetric(const double* x, const double* y, const double* mass, size_t n,
+                             double px, double py, double pm, double* ax, double* ay, double epsilonSq);
+
+// Best instruction set this CPU supports, used by default
+ForceIsa bestForceIsa();
+
+// Whether the CPU (and this build) can run a kernel
+bool forceIsaSupported(ForceIsa isa);
+
+// Switch kernels, e.g. for benchmarking. Returns false and keeps the current one if isa is
+// unsupported. Not thread safe: call it between steps, not during the force phase
+bool setForceIsa(ForceIsa isa);
+ForceIsa getForceIsa();
+
+const char* forceIsaName(ForceIsa isa);
+
+#endif // FORCEKERNEL_H
@@ -0,0 +1,41 @@
+#include "FrameArena.h"
+#include <algorithm>
+
+// Offset rounded up to a multiple of alignment, a power of two
+static size_t alignUp(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+void* FrameArena::allocBytes(size_t bytes, size_t alignment) {
+    m_requested += bytes + alignment - 1;
+
+    size_t offset = alignUp(m_used, alignment);
+    if (offset + bytes <= m_capacity) {
+        m_used = offset + bytes;
+        return m_block.get() + offset;
+    }
+
+    // Out of room, continue in the newest overflow block or start a bigger one
+    offset = alignUp(m_overflowUsed, alignment);
+    if (m_overflow.empty() || offset + bytes > m_overflowCapacity) {
+        m_overflowCapacity = std::max(bytes + alignment, 2 * std::max(m_capacity, m_overflowCapacity));
+        m_overflow.emplace_back(new unsigned char[m_overflowCapacity]);
+        offset = 0;
+    }
+    m_overflowUsed = offset + bytes;
+    return m_overflow.back().get() + offset;
+}
+
+void FrameArena::reset() {
+    // Merge into one block that fits everything the last step asked for
+    if (!m_overflow.empty()) {
+        m_overflow.clear();
+        m_capacity = m_requested;
+        m_block.reset(new unsigned char[m_capacity]);
+    }
+
+    m_used = 0;
+    m_overflowUsed = 0;
+    m_overflowCapacity = 0;
+    m_requested = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+// Bump allocator for buffers that only live for one step. alloc() hands out consecutive
+// pieces of one block and reset() takes them all back at once, nothing is freed in between.
+// A step that needs more than the block holds gets extra blocks, and the next reset()
+// replaces them with a single block as large as that whole step, so once the sizes settle
+// stepping allocates nothing.
+class FrameArena {
+private:
+    std::unique_ptr<unsigned char[]> m_block;
+    size_t m_capacity = 0;
+    size_t m_used = 0;
+
+    // Blocks added during this step when m_block ran out, and how many bytes the step asked for
+    std::vector<std::unique_ptr<unsigned char[]>> m_overflow;
+    size_t m_overflowUsed = 0;
+    size_t m_overflowCapacity = 0;
+    size_t m_requested = 0;
+
+    void* allocBytes(size_t bytes, size_t alignment);
+
+public:
+    FrameArena() = default;
+    FrameArena(FrameArena&&) = default;
+    FrameArena& operator=(FrameArena&&) = default;
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Uninitialized room for count Ts, valid until the next reset(). Destructors never run
+    template <typename T>
+    T* alloc(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is dropped without destructors");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+        return static_cast<T*>(allocBytes(count * sizeof(T), alignof(T)));
+    }
+
+    // Release everything handed out since the last reset
+    void reset();
+
+    // Bytes the arena can hand out per step without allocating
+    size_t capacity() const { return m_capacity; }
+};
+
+#endif // FRAMEARENA_H
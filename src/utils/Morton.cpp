@@ -0,0 +1,49 @@
+#include "Morton.h"
+#include <array>
+#include <algorithm>
+
+void mortonRadixSort(uint64_t* keys, uint32_t* order, size_t n,
+                     uint64_t* keyScratch, uint32_t* orderScratch)
+{
+    if (n < 2) return;
+
+    uint64_t* srcKeys = keys;
+    uint32_t* srcOrder = order;
+    uint64_t* dstKeys = keyScratch;
+    uint32_t* dstOrder = orderScratch;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        std::array<size_t, 256> counts {};
+        for (size_t i = 0; i < n; ++i) {
+            counts[(srcKeys[i] >> shift) & 0xFF]++;
+        }
+
+        // Every key has the same byte here, this pass would not move anything
+        if (counts[(srcKeys[0] >> shift) & 0xFF] == n) {
+            continue;
+        }
+
+        // Exclusive prefix sum gives the first output slot for each bucket
+        size_t total = 0;
+        for (size_t& c : counts) {
+            size_t count = c;
+            c = total;
+            total += count;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            size_t dst = counts[(srcKeys[i] >> shift) & 0xFF]++;
+            dstKeys[dst] = srcKeys[i];
+            dstOrder[dst] = srcOrder[i];
+        }
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcOrder, dstOrder);
+    }
+
+    // An odd number of passes leaves the result in the scratch arrays
+    if (srcKeys != keys) {
+        std::copy(srcKeys, srcKeys + n, keys);
+        std::copy(srcOrder, srcOrder + n, order);
+    }
+}
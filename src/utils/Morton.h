@@ -0,0 +1,112 @@
+#ifndef MORTON_H
+#define MORTON_H
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+
+// Helpers for ordering 2D positions along a Z-order (Morton) curve.
+// Digit layout matches Quad::findQuadrant: bit 0 of every 2-bit digit is x, bit 1 is y,
+// so the top digit of a key is the root quadrant, the next one the child quadrant, etc.
+
+// Number of quadtree levels representable by a 64-bit key
+const constexpr int MORTON_LEVELS = 32;
+
+// Spreads the 32 bits of v so there is a zero bit between each of them
+inline uint64_t mortonSpread(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2))  & 0x3333333333333333ull;
+    x = (x | (x << 1))  & 0x5555555555555555ull;
+    return x;
+}
+
+// Interleaves x (even bits) and y (odd bits) into a 64-bit Morton key
+inline uint64_t mortonEncode(uint32_t x, uint32_t y) {
+    return mortonSpread(x) | (mortonSpread(y) << 1);
+}
+
+// Morton keys in D dimensions for Orthtree: every D-bit digit holds bit d of coordinate d,
+// so a 64-bit key tells apart 64 / D levels (32 in 2D, 21 in 3D)
+template <size_t D>
+constexpr int mortonLevels = 64 / D;
+
+// Spreads the 21 low bits of v so there are two zero bits between each of them
+inline uint64_t mortonSpread3(uint32_t v) {
+    uint64_t x = v & 0x1FFFFF;
+    x = (x | (x << 32)) & 0x001F00000000FFFFull;
+    x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+    x = (x | (x << 8))  & 0x100F00F00F00F00Full;
+    x = (x | (x << 4))  & 0x10C30C30C30C30C3ull;
+    x = (x | (x << 2))  & 0x1249249249249249ull;
+    return x;
+}
+
+// Interleaves D cell coordinates of mortonLevels<D> bits each
+template <size_t D>
+inline uint64_t mortonEncode(const std::array<uint32_t, D>& cell) {
+    if constexpr (D == 2) {
+        return mortonEncode(cell[0], cell[1]);
+    } else if constexpr (D == 3) {
+        return mortonSpread3(cell[0]) | (mortonSpread3(cell[1]) << 1) | (mortonSpread3(cell[2]) << 2);
+    } else {
+        uint64_t key = 0;
+        for (int bit = mortonLevels<D> - 1; bit >= 0; --bit) {
+            for (size_t d = D; d-- > 0;) {
+                key = (key << 1) | ((cell[d] >> bit) & 1);
+            }
+        }
+        return key;
+    }
+}
+
+// Child (0 to 2^D - 1) of a D-dimensional key at the given tree depth (0 = children of the root)
+template <size_t D>
+inline size_t mortonDigit(uint64_t key, int level) {
+    return static_cast<size_t>((key >> (D * (mortonLevels<D> - 1 - level))) & ((size_t(1) << D) - 1));
+}
+
+// Distance of cell (x, y) along a Hilbert curve covering the 2^32 x 2^32 grid. Unlike Morton
+// order, consecutive keys are always neighbouring cells, so there are no long jumps between quadrants.
+// Walks the Morton digits from the top with a 4-state machine; the state is how the current
+// sub-square is rotated or mirrored relative to the root
+inline uint64_t hilbertEncode(uint32_t x, uint32_t y) {
+    // Hilbert digit and next state for each state and Morton digit
+    static const uint8_t digit[4][4] = {{0, 3, 1, 2}, {0, 1, 3, 2}, {2, 1, 3, 0}, {2, 3, 1, 0}};
+    static const uint8_t next[4][4] = {{1, 3, 0, 0}, {0, 1, 2, 1}, {2, 2, 1, 3}, {3, 0, 3, 2}};
+
+    uint64_t morton = mortonEncode(x, y);
+    uint64_t key = 0;
+    unsigned state = 0;
+    for (int level = 0; level < MORTON_LEVELS; ++level) {
+        unsigned quadrant = static_cast<unsigned>(morton >> (2 * (MORTON_LEVELS - 1 - level))) & 3;
+        key = (key << 2) | digit[state][quadrant];
+        state = next[state][quadrant];
+    }
+    return key;
+}
+
+// Quadrant (0-3) of a key at the given tree depth (0 = children of the root)
+inline size_t mortonDigit(uint64_t key, int level) {
+    return static_cast<size_t>((key >> (2 * (MORTON_LEVELS - 1 - level))) & 3);
+}
+
+// Sorts n keys ascending with an LSD radix sort (8 bits per pass), applying the same
+// permutation to order. Passes where every key shares the same byte are skipped.
+// The scratch arrays must hold n entries; the result always ends up in keys/order.
+void mortonRadixSort(uint64_t* keys, uint32_t* order, size_t n,
+                     uint64_t* keyScratch, uint32_t* orderScratch);
+
+// Vector overload, scratch vectors are grown as needed and reused between calls. Takes any
+// vectors of uint64_t keys and uint32_t indices, whatever their allocator
+template <typename KeyVector, typename OrderVector>
+void mortonRadixSort(KeyVector& keys, OrderVector& order, KeyVector& keyScratch, OrderVector& orderScratch)
+{
+    keyScratch.resize(keys.size());
+    orderScratch.resize(order.size());
+    mortonRadixSort(keys.data(), order.data(), keys.size(), keyScratch.data(), orderScratch.data());
+}
+
+#endif // MORTON_H
@@ -0,0 +1,207 @@
+#ifndef ORTHTREE_H
+#define ORTHTREE_H
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include "Vec.h"
+#include "Morton.h"
+#include "ForceKernel.h"
+#include "constants.h"
+
+// Cube cell in D dimensions, the Orthtree counterpart of Quad
+template <size_t D>
+struct Box {
+    Vec<D> center;
+    double size = 0.0; // Side length
+
+    Box() = default;
+    Box(Vec<D> center, double size) : center(center), size(size) {}
+
+    // Padded cube containing n positions, pos[d][i] being coordinate d of position i
+    static Box containing(size_t n, const std::array<const double*, D>& pos) {
+        if (n == 0) {
+            return Box(Vec<D>(), 10.0); // Default size if no bodies
+        }
+
+        Vec<D> center;
+        double size = 0.0;
+        for (size_t d = 0; d < D; ++d) {
+            auto range = std::minmax_element(pos[d], pos[d] + n);
+            center[d] = (*range.first + *range.second) * 0.5;
+            size = std::max(size, *range.second - *range.first);
+        }
+
+        // Same padding and minimum as Quad::newContaining
+        return Box(center, std::max(size * 1.1, 1e-6));
+    }
+
+    // Child (0 to 2^D - 1) a position belongs to, bit d set when it is above the center on axis d
+    size_t findChild(const Vec<D>& pos) const {
+        size_t child = 0;
+        for (size_t d = 0; d < D; ++d) {
+            child |= (pos[d] > center[d] ? size_t(1) : 0) << d;
+        }
+        return child;
+    }
+
+    Box intoChild(size_t child) const {
+        Vec<D> childCenter = center;
+        double quarter = size * 0.25;
+        for (size_t d = 0; d < D; ++d) {
+            childCenter[d] += ((child >> d) & 1) ? quarter : -quarter;
+        }
+        return Box(childCenter, size * 0.5);
+    }
+
+    // Morton key of a position, quantized to mortonLevels<D> levels and clamped to the box.
+    // Its digits are the findChild() indices from the root down
+    uint64_t mortonKey(const Vec<D>& pos) const {
+        constexpr double cells = static_cast<double>(uint64_t(1) << mortonLevels<D>);
+        std::array<uint32_t, D> cell;
+        for (size_t d = 0; d < D; ++d) {
+            // Rounded like Quad::gridCell, so positions on a split line take the lower cell
+            double t = std::ceil((pos[d] - (center[d] - size * 0.5)) / size * cells) - 1.0;
+            cell[d] = static_cast<uint32_t>(std::min(std::max(t, 0.0), cells - 1.0));
+        }
+        return mortonEncode<D>(cell);
+    }
+};
+
+// Barnes-Hut tree with 2^D children per cell: a quadtree for D = 2, an octree for D = 3.
+// Built in one pass over the bodies sorted by Morton key, like Quadtree::buildMorton. Nodes are
+// stored depth first, so an opened node continues at the next node and `next` skips a whole
+// subtree, and acc() walks the array front to back.
+// Monopoles and the geometric criterion only; the 2D Simulation uses Quadtree, which adds the
+// other builders, criteria, quadrupoles and the multipole and group solvers
+template <size_t D>
+class Orthtree {
+public:
+    static constexpr size_t CHILDREN = size_t(1) << D;
+
+private:
+    struct Node {
+        Vec<D> com;       // Center of mass
+        double mass;      // Total mass
+        double sizeSq;    // Squared side length
+        uint32_t next;    // Node after this subtree, nodeCount() after the last one
+        uint32_t first;   // Bodies [first, last) in the sorted arrays
+        uint32_t last;
+        bool leaf;
+    };
+
+    double m_thetasq;
+    double m_epsilonsq;
+    size_t m_leafCapacity = 8;
+
+    std::vector<Node> m_nodes;
+    std::vector<uint64_t> m_keys;
+    std::vector<uint32_t> m_order;     // Body index of each sorted entry
+    std::vector<uint64_t> m_keyScratch;
+    std::vector<uint32_t> m_orderScratch;
+    std::vector<Vec<D>> m_sortedPos;   // Positions and masses in Morton order, read by the leaves
+    std::vector<double> m_sortedMass;
+
+    // Emit the subtree of sorted bodies [first, last) in box, returns its node
+    uint32_t emit(const Box<D>& box, size_t first, size_t last, int level) {
+        uint32_t index = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.push_back(Node{Vec<D>(), 0.0, box.size * box.size, 0,
+                               static_cast<uint32_t>(first), static_cast<uint32_t>(last), false});
+
+        Vec<D> weighted;
+        double mass = 0.0;
+        if (last - first <= m_leafCapacity || level == mortonLevels<D>) {
+            for (size_t i = first; i < last; ++i) {
+                weighted += m_sortedPos[i] * m_sortedMass[i];
+                mass += m_sortedMass[i];
+            }
+            m_nodes[index].leaf = true;
+        } else {
+            // Children are contiguous runs of the sorted keys, found by their digit at this level
+            size_t begin = first;
+            for (size_t child = 0; child < CHILDREN && begin < last; ++child) {
+                size_t end = std::partition_point(m_keys.begin() + begin, m_keys.begin() + last,
+                    [&](uint64_t key) { return mortonDigit<D>(key, level) <= child; }) - m_keys.begin();
+                if (end > begin) {
+                    uint32_t node = emit(box.intoChild(child), begin, end, level + 1);
+                    weighted += m_nodes[node].com * m_nodes[node].mass;
+                    mass += m_nodes[node].mass;
+                }
+                begin = end;
+            }
+        }
+
+        m_nodes[index].com = mass > 0.0 ? weighted / mass : box.center;
+        m_nodes[index].mass = mass;
+        m_nodes[index].next = static_cast<uint32_t>(m_nodes.size());
+        return index;
+    }
+
+public:
+    Orthtree(double theta, double epsilon) : m_thetasq(theta * theta), m_epsilonsq(epsilon * epsilon) {}
+
+    void setTheta(double theta) { m_thetasq = theta * theta; }
+    void setLeafCapacity(size_t capacity) { m_leafCapacity = std::max<size_t>(capacity, 1); }
+    size_t getLeafCapacity() const { return m_leafCapacity; }
+    size_t nodeCount() const { return m_nodes.size(); }
+
+    // Body indices in tree order, valid after build()
+    const std::vector<uint32_t>& getBodyOrder() const { return m_order; }
+
+    // Rebuild the tree over n bodies in box, pos[d][i] being coordinate d of body i
+    void build(size_t n, const std::array<const double*, D>& pos, const double* mass, const Box<D>& box) {
+        m_nodes.clear();
+        m_keys.resize(n);
+        m_order.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            Vec<D> p;
+            for (size_t d = 0; d < D; ++d) p[d] = pos[d][i];
+            m_keys[i] = box.mortonKey(p);
+            m_order[i] = static_cast<uint32_t>(i);
+        }
+        mortonRadixSort(m_keys, m_order, m_keyScratch, m_orderScratch);
+
+        m_sortedPos.resize(n);
+        m_sortedMass.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t body = m_order[i];
+            for (size_t d = 0; d < D; ++d) m_sortedPos[i][d] = pos[d][body];
+            m_sortedMass[i] = mass[body];
+        }
+
+        if (n > 0) {
+            emit(box, 0, n, 0);
+        }
+    }
+
+    // Acceleration at pos from every body in the tree
+    Vec<D> acc(const Vec<D>& pos) const {
+        Vec<D> acceleration;
+        size_t node = 0;
+        size_t end = m_nodes.size();
+        while (node < end) {
+            const Node& n = m_nodes[node];
+            Vec<D> d = n.com - pos;
+            // Same opening test and kernel as Quadtree, with its geometric criterion
+            bool far = isFarCell(n.sizeSq, n.mass, d.magSqrd(), m_thetasq, 0.0);
+
+            if (far) {
+                addPointMass(acceleration, d, n.mass, m_epsilonsq);
+            } else if (n.leaf) {
+                // Too close to treat the leaf as one mass, sum its bodies directly
+                for (uint32_t i = n.first; i < n.last; ++i) {
+                    addPointMass(acceleration, m_sortedPos[i] - pos, m_sortedMass[i], m_epsilonsq);
+                }
+            } else {
+                ++node; // Open it, the first child comes next
+                continue;
+            }
+            node = n.next;
+        }
+        return acceleration;
+    }
+};
+
+#endif // ORTHTREE_H
@@ -0,0 +1,280 @@
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H
+#include <vector>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include "Vec.h"
+#include "Orthtree.h"
+#include "Collision.h"
+#include "FrameArena.h"
+#include "BatchMath.h"
+#include "constants.h"
+#include "../headers/ThreadPool.h"
+
+// Bodies and the leapfrog step in D dimensions: an Orthtree for gravity and the same
+// sweep-and-prune collision pass as Simulation. ParticleSystem<3> runs 3D models,
+// ParticleSystem<2> the same models in the plane. There is no rendering or editing, the
+// interactive 2D simulation stays with Simulation and BodyStore
+template <size_t D>
+class ParticleSystem {
+private:
+    // One array per axis, like BodyStore
+    std::array<std::vector<double>, D> m_pos;   // AU
+    std::array<std::vector<double>, D> m_vel;   // AU/yr
+    std::array<std::vector<double>, D> m_acc;   // AU/yr²
+    std::vector<double> m_mass;                 // Solar masses
+    std::vector<double> m_radius;               // AU
+
+    Orthtree<D> m_tree;
+    FrameArena m_frameArena;  // Collision buffers, reset every step
+
+    double m_lastTreeTimeMs = 0.0;
+    double m_lastForceCalcTimeMs = 0.0;
+    double m_lastCollisionTimeMs = 0.0;
+
+    Vec<D> load(const std::array<std::vector<double>, D>& field, size_t i) const {
+        Vec<D> v;
+        for (size_t d = 0; d < D; ++d) v[d] = field[d][i];
+        return v;
+    }
+
+    void store(std::array<std::vector<double>, D>& field, size_t i, const Vec<D>& v) {
+        for (size_t d = 0; d < D; ++d) field[d][i] = v[d];
+    }
+
+    void kick(double dt) {
+        for (size_t d = 0; d < D; ++d) axpy(size(), dt, m_acc[d].data(), m_vel[d].data());
+    }
+
+    void drift(double dt) {
+        for (size_t d = 0; d < D; ++d) axpy(size(), dt, m_vel[d].data(), m_pos[d].data());
+    }
+
+    void handleCollisions() {
+        size_t n = size();
+        if (n < 2) return;
+
+        // Sort by the low edge on axis 0, then lay out the edges in that order
+        struct SweepKey {
+            double lo;
+            uint32_t id;
+        };
+        SweepKey* keys = m_frameArena.alloc<SweepKey>(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = {m_pos[0][i] - m_radius[i], static_cast<uint32_t>(i)};
+        }
+        std::sort(keys, keys + n, [](const SweepKey& a, const SweepKey& b) { return a.lo < b.lo; });
+
+        std::array<const double*, D> lo;
+        std::array<const double*, D> hi;
+        for (size_t d = 0; d < D; ++d) {
+            double* low = m_frameArena.alloc<double>(n);
+            double* high = m_frameArena.alloc<double>(n);
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t id = keys[i].id;
+                low[i] = m_pos[d][id] - m_radius[id];
+                high[i] = m_pos[d][id] + m_radius[id];
+            }
+            lo[d] = low;
+            hi[d] = high;
+        }
+
+        sweepAndPrune<D>(n, lo, hi, [&](size_t i, size_t j) {
+            uint32_t a = keys[i].id;
+            uint32_t b = keys[j].id;
+            Vec<D> pa = load(m_pos, a), va = load(m_vel, a);
+            Vec<D> pb = load(m_pos, b), vb = load(m_vel, b);
+            if (resolveContact(pa, va, m_mass[a], m_radius[a], pb, vb, m_mass[b], m_radius[b], 0.5)) {
+                store(m_pos, a, pa);
+                store(m_vel, a, va);
+                store(m_pos, b, pb);
+                store(m_vel, b, vb);
+            }
+        });
+    }
+
+public:
+    ParticleSystem(double theta = 0.5) : m_tree(theta, SOFTENING) {}
+
+    size_t size() const { return m_mass.size(); }
+    bool empty() const { return m_mass.empty(); }
+
+    void clear() {
+        for (size_t d = 0; d < D; ++d) {
+            m_pos[d].clear();
+            m_vel[d].clear();
+            m_acc[d].clear();
+        }
+        m_mass.clear();
+        m_radius.clear();
+    }
+
+    void addBody(const Vec<D>& pos, const Vec<D>& vel, double mass, double radius) {
+        for (size_t d = 0; d < D; ++d) {
+            m_pos[d].push_back(pos[d]);
+            m_vel[d].push_back(vel[d]);
+            m_acc[d].push_back(0.0);
+        }
+        m_mass.push_back(mass);
+        m_radius.push_back(radius);
+    }
+
+    Vec<D> getPos(size_t i) const { return load(m_pos, i); }
+    Vec<D> getVel(size_t i) const { return load(m_vel, i); }
+    Vec<D> getAcc(size_t i) const { return load(m_acc, i); }
+    double getMass(size_t i) const { return m_mass[i]; }
+
+    Orthtree<D>& getTree() { return m_tree; }
+    double getLastTreeBuildTimeMs() const { return m_lastTreeTimeMs; }
+    double getLastForceCalcTimeMs() const { return m_lastForceCalcTimeMs; }
+    double getLastCollisionTimeMs() const { return m_lastCollisionTimeMs; }
+
+    // Rebuild the tree and set every body's acceleration, split into chunks tasks on pool
+    void computeForces(ThreadPool& pool, size_t chunks) {
+        using namespace std::chrono;
+        size_t n = size();
+
+        auto startTree = high_resolution_clock::now();
+        std::array<const double*, D> pos;
+        for (size_t d = 0; d < D; ++d) pos[d] = m_pos[d].data();
+        m_tree.build(n, pos, m_mass.data(), Box<D>::containing(n, pos));
+        auto endTree = high_resolution_clock::now();
+        m_lastTreeTimeMs = duration<double, std::milli>(endTree - startTree).count();
+
+        chunks = std::max<size_t>(chunks, 1);
+        size_t perChunk = (n + chunks - 1) / chunks;
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t start = c * perChunk;
+            size_t end = std::min(start + perChunk, n);
+            if (start >= end) break;
+
+            pool.enqueue([this, start, end]() {
+                for (size_t i = start; i < end; ++i) {
+                    store(m_acc, i, m_tree.acc(load(m_pos, i)));
+                }
+            });
+        }
+        pool.wait();
+        m_lastForceCalcTimeMs = duration<double, std::milli>(high_resolution_clock::now() - endTree).count();
+    }
+
+    // Leapfrog step: half kick, drift, collisions, new forces, half kick
+    void update(years_t deltaT, ThreadPool& pool, size_t chunks, bool enableCollisions = true) {
+        if (empty()) return;
+        m_frameArena.reset();
+
+        double dt = deltaT.count();
+        kick(dt / 2.0);
+        drift(dt);
+
+        auto startColl = std::chrono::high_resolution_clock::now();
+        if (enableCollisions) { handleCollisions(); }
+        m_lastCollisionTimeMs = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - startColl).count();
+
+        computeForces(pool, chunks);
+        kick(dt / 2.0);
+    }
+
+    // Kinetic plus softened potential energy, summing every pair. Softened like
+    // Simulation::calculateTotalEnergy, with SOFTENING added to the squared distance, so 2D
+    // numbers from both can be compared
+    double calculateTotalEnergy() const {
+        size_t n = size();
+        double kinetic = 0.0;
+        double potential = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            Vec<D> pos = getPos(i);
+            kinetic += 0.5 * m_mass[i] * getVel(i).magSqrd();
+            double sum = 0.0;
+            for (size_t j = i + 1; j < n; ++j) {
+                sum += m_mass[j] / std::sqrt((getPos(j) - pos).magSqrd() + SOFTENING);
+            }
+            potential -= GC * m_mass[i] * sum;
+        }
+        return kinetic + potential;
+    }
+
+    // Exact acceleration at a position from every body with the trees' kernel, skipping any body
+    // sitting on it
+    Vec<D> accAt(const Vec<D>& pos) const {
+        Vec<D> acceleration;
+        for (size_t j = 0; j < size(); ++j) {
+            addPointMass(acceleration, getPos(j) - pos, m_mass[j], SOFTENING * SOFTENING);
+        }
+        return acceleration;
+    }
+
+    // Star with a disk of planetesimals around it, like Simulation::generateProPlanetaryDisk.
+    // The disk lies in the plane of the first two axes, further axes get its thickness
+    void generateDisk(int count, unsigned seed) {
+        std::mt19937 gen(seed);
+        addBody(Vec<D>(), Vec<D>(), 1.0, 0.06);
+
+        std::uniform_real_distribution<> massDist(-8, -4);
+        std::uniform_real_distribution<> radiusDist(0, 1.0);
+        std::uniform_real_distribution<> angleDist(0, 2 * M_PI);
+        std::uniform_real_distribution<> eccDist(0, 0.05);
+        std::normal_distribution<> inclinationDist(0, 0.01);
+
+        for (int i = 1; i < count; i++) {
+            double mass = std::pow(10, massDist(gen));
+
+            // Surface density ∝ r^-1.5 between 0.5 and 8 AU, by inverse transform sampling
+            double rMin = 0.5;
+            double rMax = 8.0;
+            double distance = std::pow(
+                std::pow(rMin, -0.5) + radiusDist(gen) * (std::pow(rMax, -0.5) - std::pow(rMin, -0.5)), -2.0);
+            double angle = angleDist(gen);
+
+            Vec<D> pos;
+            Vec<D> vel;
+            pos[0] = std::cos(angle) * distance;
+            pos[1] = std::sin(angle) * distance;
+            for (size_t d = 2; d < D; ++d) {
+                pos[d] = inclinationDist(gen) * distance;
+            }
+
+            // Slightly eccentric prograde orbit
+            double speed = std::sqrt(GC / distance) * (1.0 + eccDist(gen));
+            vel[0] = -std::sin(angle) * speed;
+            vel[1] = std::cos(angle) * speed;
+
+            double radius = 0.02 + 0.005 * (std::log10(mass) + 8.0);
+            addBody(pos, vel, mass, radius);
+        }
+    }
+
+    // Plummer star cluster of one solar mass and scale radius `scale` AU, cut off at ten
+    // scale radii, with isotropic velocities at the 3D Plummer sphere's virial dispersion
+    void generateCluster(int count, unsigned seed, double scale = 1.0) {
+        if (count <= 0) return;
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<> uniform(0.0, 1.0);
+        std::normal_distribution<> normal(0.0, 1.0);
+
+        double mass = 1.0 / count;
+        double sigma = std::sqrt(M_PI * GC / (32.0 * scale));
+        for (int i = 0; i < count; i++) {
+            // Radius from the inverse of the enclosed mass fraction, (r² / (r² + a²))^(D / 2)
+            double distance;
+            do {
+                double u = std::pow(uniform(gen), 2.0 / D);
+                distance = scale * std::sqrt(u / (1.0 - u));
+            } while (!(distance < 10.0 * scale));
+
+            Vec<D> dir;
+            Vec<D> vel;
+            for (size_t d = 0; d < D; ++d) {
+                dir[d] = normal(gen);
+                vel[d] = normal(gen) * sigma;
+            }
+            addBody(dir.normalized() * distance, vel, mass, 0.005);
+        }
+    }
+};
+
+#endif // PARTICLESYSTEM_H
@@ -1,27 +1,25 @@
 #include "QuadTree.h"
-#include "../headers/body.h"
+#include "../headers/BodyStore.h"
+#include "ForceKernel.h"
 
 // Quad implementation
-Quad Quad::newContaining(const std::vector<Body>& bodies) {
-    if (bodies.empty()) {
-        return Quad(Vec2(0, 0), 10.0); // Default size if no bodies
+Quad Quad::newContaining(const BodyStore& bodies) {
+    Bounds bounds;
+    const double* x = bodies.x();
+    const double* y = bodies.y();
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        bounds.include(x[i], y[i]);
     }
+    return containing(bounds);
+}
 
-    double min_x = std::numeric_limits<double>::max();
-    double min_y = std::numeric_limits<double>::max();
-    double max_x = std::numeric_limits<double>::lowest();
-    double max_y = std::numeric_limits<double>::lowest();
-
-    for (const auto& body : bodies) {
-        Vec2 pos = body.getPos();
-        min_x = std::min(min_x, pos.getX());
-        min_y = std::min(min_y, pos.getY());
-        max_x = std::max(max_x, pos.getX());
-        max_y = std::max(max_y, pos.getY());
+Quad Quad::containing(const Bounds& bounds) {
+    if (bounds.empty()) {
+        return Quad(Vec2(0, 0), 10.0); // Default size if no bodies
     }
 
-    Vec2 center((min_x + max_x) * 0.5, (min_y + max_y) * 0.5);
-    double size = std::max(max_x - min_x, max_y - min_y);
+    Vec2 center((bounds.minX + bounds.maxX) * 0.5, (bounds.minY + bounds.maxY) * 0.5);
+    double size = std::max(bounds.maxX - bounds.minX, bounds.maxY - bounds.minY);
 
     // Add some padding and clamp to a minimum so degenerate cases do not spin subdivides
     size = std::max(size * 1.1, 1e-6);
@@ -52,16 +50,52 @@ std::array<Quad, 4> Quad::subdivide() const {
     };
 }
 
+void Quad::gridCell(Vec2 pos, uint32_t& x, uint32_t& y) const {
+    // ceil(t) - 1 puts positions exactly on a split line into the lower cell,
+    // matching the strict '>' test in findQuadrant
+    const double cells = 4294967296.0; // 2^MORTON_LEVELS
+    double half = size * 0.5;
+    double tx = std::ceil((pos.getX() - (center.getX() - half)) / size * cells) - 1.0;
+    double ty = std::ceil((pos.getY() - (center.getY() - half)) / size * cells) - 1.0;
+
+    tx = std::min(std::max(tx, 0.0), cells - 1.0);
+    ty = std::min(std::max(ty, 0.0), cells - 1.0);
+
+    x = static_cast<uint32_t>(tx);
+    y = static_cast<uint32_t>(ty);
+}
+
+uint64_t Quad::mortonKey(Vec2 pos) const {
+    uint32_t x, y;
+    gridCell(pos, x, y);
+    return mortonEncode(x, y);
+}
+
+uint64_t Quad::hilbertKey(Vec2 pos) const {
+    uint32_t x, y;
+    gridCell(pos, x, y);
+    return hilbertEncode(x, y);
+}
+
 // Quadtree implementation
+
+// Tolerance factor of OpeningCriterion::RelativeAccuracy. Fitted against Geometric on 2k-5k body
+// disks around a central mass, where both reach the same RMS force error at the same theta
+// from 0.2 to 0.7
+static double relativeAccuracyScale(double theta) {
+    return 0.027 * std::pow(theta, 3.5);
+}
+
 Quadtree::Quadtree(double theta, double epsilon) 
-    : m_thetasq(theta * theta), m_epsilonsq(epsilon * epsilon) {
+    : m_thetasq(theta * theta), m_accScale(relativeAccuracyScale(theta)), m_epsilonsq(epsilon * epsilon), m_leafCapacity(1), m_quadrupole(false), m_splitLevels(3) {
 }
 
 void Quadtree::reserve(size_t bodyCount) {
-    // Barnes-Hut produces up to ~4n nodes; reserve to limit per-frame allocations
-    size_t expectedNodes = bodyCount > 0 ? bodyCount * 4 + 1 : 0;
+    // Barnes-Hut produces up to ~4n/k nodes for k bodies per leaf; reserve to limit per-frame allocations
+    size_t expectedNodes = bodyCount > 0 ? (bodyCount * 4) / m_leafCapacity + 1 : 0;
     if (expectedNodes > m_nodes.capacity()) {
         m_nodes.reserve(expectedNodes);
+        m_cells.reserve(expectedNodes);
     }
 
     if (bodyCount > m_parents.capacity()) {
@@ -70,27 +104,37 @@ void Quadtree::reserve(size_t bodyCount) {
 }
 
 void Quadtree::clear(Quad quad) {
+    m_topologyVersion++;
+    m_leavesIndexed = false;
+    m_hasBodyOrder = false;
     m_nodes.clear();
+    m_cells.clear();
     m_parents.clear();
-    m_nodes.push_back(Node(0, quad));
+    m_nodes.push_back(Node(0, quad.size));
+    m_cells.push_back(Cell(quad));
 }
 
 size_t Quadtree::subdivide(size_t node) {
-    m_parents.push_back(node);
-    size_t children = m_nodes.size();
-    m_nodes[node].children = children;
+    return subdivide(NodeBuffer{m_nodes, m_cells, m_parents}, node);
+}
 
-    std::array<size_t, 4> nexts = {
+size_t Quadtree::subdivide(NodeBuffer out, size_t node) {
+    out.parents.push_back(node);
+    uint32_t children = static_cast<uint32_t>(out.nodes.size());
+    out.nodes[node].children = children;
+
+    std::array<uint32_t, 4> nexts = {
         children + 1,
         children + 2,
         children + 3,
-        m_nodes[node].next
+        out.nodes[node].next
     };
     
-    std::array<Quad, 4> quads = m_nodes[node].quad.subdivide();
+    std::array<Quad, 4> quads = out.cells[node].quad.subdivide();
     
     for (size_t i = 0; i < 4; i++) {
-        m_nodes.push_back(Node(nexts[i], quads[i]));
+        out.nodes.push_back(Node(nexts[i], quads[i].size));
+        out.cells.push_back(Cell(quads[i]));
     }
 
     return children;
@@ -101,23 +145,23 @@ void Quadtree::insert(Vec2 pos, double mass) {
 
     // Navigate to appropriate leaf
     while (m_nodes[node].isBranch()) {
-        size_t quadrant = m_nodes[node].quad.findQuadrant(pos);
+        size_t quadrant = m_cells[node].quad.findQuadrant(pos);
         node = m_nodes[node].children + quadrant;
     }
 
     // If leaf is empty, just insert here
     if (m_nodes[node].isEmpty()) {
-        m_nodes[node].pos = pos;
-        m_nodes[node].mass = mass;
+        m_nodes[node].setPos(pos);
+        m_nodes[node].mass = static_cast<float>(mass);
         return;
     }
 
     // If same position, add mass
-    Vec2 existingPos = m_nodes[node].pos;
-    double existingMass = m_nodes[node].mass;
+    Vec2 existingPos = m_nodes[node].getPos();
+    float existingMass = m_nodes[node].mass;
     
     if (pos.getX() == existingPos.getX() && pos.getY() == existingPos.getY()) {
-        m_nodes[node].mass += mass;
+        m_nodes[node].mass += static_cast<float>(mass);
         return;
     }
 
@@ -125,8 +169,8 @@ void Quadtree::insert(Vec2 pos, double mass) {
     while (true) {
         size_t children = subdivide(node);
 
-        size_t q1 = m_nodes[node].quad.findQuadrant(existingPos);
-        size_t q2 = m_nodes[node].quad.findQuadrant(pos);
+        size_t q1 = m_cells[node].quad.findQuadrant(existingPos);
+        size_t q2 = m_cells[node].quad.findQuadrant(pos);
 
         if (q1 == q2) {
             // Both go in same quadrant, continue subdividing
@@ -136,51 +180,687 @@ void Quadtree::insert(Vec2 pos, double mass) {
             size_t n1 = children + q1;
             size_t n2 = children + q2;
 
-            m_nodes[n1].pos = existingPos;
+            m_nodes[n1].setPos(existingPos);
             m_nodes[n1].mass = existingMass;
-            m_nodes[n2].pos = pos;
-            m_nodes[n2].mass = mass;
+            m_nodes[n2].setPos(pos);
+            m_nodes[n2].mass = static_cast<float>(mass);
             return;
         }
     }
 }
 
+void Quadtree::buildMorton(const BodyStore& bodies, Quad quad) {
+    clear(quad);
+    if (bodies.empty()) return;
+
+    size_t n = bodies.size();
+    m_keys.resize(n);
+    m_order.resize(n);
+    m_sortedLeaf.resize(n);
+    m_sortedPos.resize(n);
+    m_sortedMass.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        m_keys[i] = quad.mortonKey(bodies[i].getPos());
+        m_order[i] = static_cast<uint32_t>(i);
+    }
+
+    mortonRadixSort(m_keys, m_order, m_keyScratch, m_orderScratch);
+    gatherSorted(bodies, 0, n);
+    emitMorton(NodeBuffer{m_nodes, m_cells, m_parents}, m_root, 0, n, 0);
+    m_hasBodyOrder = true;
+}
+
+void Quadtree::gatherSorted(const BodyStore& bodies, size_t first, size_t last) {
+    const double* x = bodies.x();
+    const double* y = bodies.y();
+    const double* mass = bodies.mass();
+    for (size_t i = first; i < last; ++i) {
+        uint32_t body = m_order[i];
+        m_sortedPos[i] = Vec2(x[body], y[body]);
+        m_sortedMass[i] = mass[body];
+    }
+}
+
+void Quadtree::setLeaf(Node& node, Cell& cell, size_t first, size_t last) {
+    cell.first = static_cast<uint32_t>(first);
+    cell.count = static_cast<uint32_t>(last - first);
+
+    if (last - first == 1) {
+        node.children = 0;
+        node.setPos(m_sortedPos[first]);
+        node.mass = static_cast<float>(m_sortedMass[first]);
+        return;
+    }
+
+    node.children = Node::LEAF_BUCKET | cell.first;
+
+    double mass = 0.0;
+    Vec2 weighted(0, 0);
+    for (size_t i = first; i < last; ++i) {
+        mass += m_sortedMass[i];
+        weighted += m_sortedPos[i] * m_sortedMass[i];
+    }
+    node.mass = static_cast<float>(mass);
+    node.setPos(mass > 0 ? weighted / mass : m_sortedPos[first]);
+}
+
+void Quadtree::emitMorton(NodeBuffer out, size_t node, size_t first, size_t last, int level) {
+    // Few enough bodies for one leaf, or bodies sharing a full-depth key that cannot be separated.
+    // With a capacity of 1 this stops exactly where insert() would have stopped descending
+    if (last - first <= m_leafCapacity || m_keys[first] == m_keys[last - 1]) {
+        setLeaf(out.nodes[node], out.cells[node], first, last);
+        for (size_t i = first; i < last; ++i) {
+            m_sortedLeaf[i] = node;
+        }
+        return;
+    }
+
+    size_t children = subdivide(out, node);
+
+    // Keys in [first, last) share every digit above this level, so the digit here is sorted too
+    size_t begin = first;
+    for (size_t q = 0; q < 4; q++) {
+        size_t end = begin;
+        if (q == 3) {
+            end = last;
+        } else {
+            size_t lo = begin, hi = last;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (mortonDigit(m_keys[mid], level) <= q) lo = mid + 1;
+                else hi = mid;
+            }
+            end = lo;
+        }
+
+        if (end > begin) {
+            emitMorton(out, children + q, begin, end, level + 1);
+        }
+        begin = end;
+    }
+}
+
+void Quadtree::placeOnWorkers(ThreadPool& pool, size_t grain) {
+    ::placeOnWorkers(m_keys, pool, grain);
+    ::placeOnWorkers(m_order, pool, grain);
+    ::placeOnWorkers(m_keyScratch, pool, grain);
+    ::placeOnWorkers(m_orderScratch, pool, grain);
+    ::placeOnWorkers(m_sortedLeaf, pool, grain);
+    ::placeOnWorkers(m_sortedMass, pool, grain);
+}
+
+void Quadtree::buildParallel(const BodyStore& bodies, Quad quad, ThreadPool& pool, size_t chunks) {
+    clear(quad);
+    if (bodies.empty()) return;
+
+    size_t n = bodies.size();
+    size_t buckets = size_t(1) << (2 * m_splitLevels);
+    int bucketShift = 2 * (MORTON_LEVELS - m_splitLevels);
+    chunks = std::max<size_t>(1, std::min(chunks, n));
+    size_t perChunk = (n + chunks - 1) / chunks;
+
+    m_keys.resize(n);
+    m_order.resize(n);
+    m_keyScratch.resize(n);
+    m_orderScratch.resize(n);
+    m_sortedLeaf.resize(n);
+    m_sortedPos.resize(n);
+    m_sortedMass.resize(n);
+    m_chunkCounts.assign(chunks * buckets, 0);
+
+    // 1. Keys and per-chunk histograms of top-level cells (keys parked in the scratch array)
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t start = c * perChunk;
+        size_t end = std::min(start + perChunk, n);
+        if (start >= end) break;
+
+        pool.enqueue([this, &bodies, &quad, c, start, end, buckets, bucketShift]() {
+            size_t* counts = &m_chunkCounts[c * buckets];
+            for (size_t i = start; i < end; ++i) {
+                uint64_t key = quad.mortonKey(bodies[i].getPos());
+                m_keyScratch[i] = key;
+                counts[key >> bucketShift]++;
+            }
+        });
+    }
+    pool.wait();
+
+    // 2. Prefix sum, bucket-major so every top-level cell ends up contiguous
+    m_bucketStart.resize(buckets + 1);
+    size_t total = 0;
+    for (size_t b = 0; b < buckets; ++b) {
+        m_bucketStart[b] = total;
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t count = m_chunkCounts[c * buckets + b];
+            m_chunkCounts[c * buckets + b] = total;
+            total += count;
+        }
+    }
+    m_bucketStart[buckets] = total;
+
+    // 3. Scatter bodies into their buckets
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t start = c * perChunk;
+        size_t end = std::min(start + perChunk, n);
+        if (start >= end) break;
+
+        pool.enqueue([this, c, start, end, buckets, bucketShift]() {
+            size_t* offsets = &m_chunkCounts[c * buckets];
+            for (size_t i = start; i < end; ++i) {
+                uint64_t key = m_keyScratch[i];
+                size_t dst = offsets[key >> bucketShift]++;
+                m_keys[dst] = key;
+                m_order[dst] = static_cast<uint32_t>(i);
+            }
+        });
+    }
+    pool.wait();
+
+    // 4. Top levels are tiny, emit them here and collect the subtrees below them
+    if (m_subtrees.size() < buckets) {
+        m_subtrees.resize(buckets);
+    }
+    m_subtreeCount = 0;
+    emitTopLevels(bodies, m_root, 0, 0);
+
+    // 5. Sort and build every subtree on its own worker
+    for (size_t t = 0; t < m_subtreeCount; ++t) {
+        pool.enqueue([this, &bodies, t]() {
+            Subtree& subtree = m_subtrees[t];
+            size_t count = subtree.last - subtree.first;
+            mortonRadixSort(&m_keys[subtree.first], &m_order[subtree.first], count,
+                            &m_keyScratch[subtree.first], &m_orderScratch[subtree.first]);
+            gatherSorted(bodies, subtree.first, subtree.last);
+
+            subtree.nodes.clear();
+            subtree.cells.clear();
+            subtree.parents.clear();
+            const Quad& quad = m_cells[subtree.root].quad;
+            subtree.nodes.push_back(Node(m_openNext, quad.size));
+            subtree.cells.push_back(Cell(quad));
+            emitMorton(NodeBuffer{subtree.nodes, subtree.cells, subtree.parents},
+                       0, subtree.first, subtree.last, m_splitLevels);
+        });
+    }
+    pool.wait();
+
+    // 6. Give each subtree its slot in the final arrays, then copy them in parallel
+    size_t nodeCount = m_nodes.size();
+    size_t parentCount = m_parents.size();
+    for (size_t t = 0; t < m_subtreeCount; ++t) {
+        Subtree& subtree = m_subtrees[t];
+        subtree.nodeOffset = nodeCount;
+        subtree.parentOffset = parentCount;
+        nodeCount += subtree.nodes.size() - 1;
+        parentCount += subtree.parents.size();
+    }
+    m_nodes.resize(nodeCount);
+    m_cells.resize(nodeCount);
+    m_parents.resize(parentCount);
+
+    for (size_t t = 0; t < m_subtreeCount; ++t) {
+        pool.enqueue([this, t]() {
+            stitchSubtree(m_subtrees[t]);
+        });
+    }
+    pool.wait();
+    m_hasBodyOrder = true;
+}
+
+void Quadtree::emitTopLevels(const BodyStore& bodies, size_t node, size_t bucket, int level) {
+    size_t span = size_t(1) << (2 * (m_splitLevels - level)); // Buckets covered by this cell
+    size_t first = m_bucketStart[bucket];
+    size_t last = m_bucketStart[bucket + span];
+
+    if (first == last) return;
+
+    // Bodies are only sorted by bucket here, which is all a leaf needs
+    if (last - first <= m_leafCapacity) {
+        gatherSorted(bodies, first, last);
+        setLeaf(m_nodes[node], m_cells[node], first, last);
+        for (size_t i = first; i < last; ++i) {
+            m_sortedLeaf[i] = node;
+        }
+        return;
+    }
+
+    if (level == m_splitLevels) {
+        Subtree& subtree = m_subtrees[m_subtreeCount++];
+        subtree.root = node;
+        subtree.first = first;
+        subtree.last = last;
+        return;
+    }
+
+    size_t children = subdivide(node);
+    for (size_t q = 0; q < 4; q++) {
+        emitTopLevels(bodies, children + q, bucket + q * (span / 4), level + 1);
+    }
+}
+
+void Quadtree::stitchSubtree(const Subtree& subtree) {
+    // Local index 0 is the existing root node, the rest are shifted to nodeOffset
+    auto global = [&subtree](size_t local) {
+        return local == 0 ? subtree.root : subtree.nodeOffset + local - 1;
+    };
+
+    Node& root = m_nodes[subtree.root];
+    uint32_t rootNext = root.next;
+    const Node& localRoot = subtree.nodes[0];
+    root.children = localRoot.isBranch() ? static_cast<uint32_t>(global(localRoot.children)) : localRoot.children;
+    root.x = localRoot.x;
+    root.y = localRoot.y;
+    root.mass = localRoot.mass;
+    m_cells[subtree.root] = subtree.cells[0];
+
+    for (size_t i = 1; i < subtree.nodes.size(); ++i) {
+        Node node = subtree.nodes[i];
+        if (node.isBranch()) {
+            node.children = static_cast<uint32_t>(global(node.children));
+        }
+        node.next = node.next == m_openNext ? rootNext : static_cast<uint32_t>(global(node.next));
+        m_nodes[global(i)] = node;
+        m_cells[global(i)] = subtree.cells[i];
+    }
+
+    for (size_t i = 0; i < subtree.parents.size(); ++i) {
+        m_parents[subtree.parentOffset + i] = global(subtree.parents[i]);
+    }
+
+    for (size_t i = subtree.first; i < subtree.last; ++i) {
+        m_sortedLeaf[i] = global(m_sortedLeaf[i]);
+    }
+}
+
+void Quadtree::indexLeaves() {
+    size_t n = m_order.size();
+    m_bodyLeaf.resize(n);
+    m_bodyNext.resize(n);
+    m_leafHead.assign(m_nodes.size(), m_noBody);
+
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t body = m_order[i];
+        size_t leaf = m_sortedLeaf[i];
+        m_bodyLeaf[body] = leaf;
+        m_bodyNext[body] = m_leafHead[leaf];
+        m_leafHead[leaf] = body;
+    }
+    m_leavesIndexed = true;
+
+    m_builtNodes = m_nodes.size();
+    m_builtEmpty = 0;
+    for (size_t node = 0; node < m_nodes.size(); ++node) {
+        if (m_nodes[node].isLeaf() && m_leafHead[node] == m_noBody) m_builtEmpty++;
+    }
+    m_refitWaste = 0;
+}
+
+// Share of the built tree that may be appended by splits or left as emptied leaves before
+// refit() asks for a rebuild. Both make walks longer without holding any more bodies
+static constexpr double MAX_REFIT_WASTE = 0.25;
+
+bool Quadtree::refit(const BodyStore& bodies, Quad bounds, double maxMigrated) {
+    size_t n = bodies.size();
+    if (!m_leavesIndexed || n == 0 || n != m_bodyLeaf.size()
+        || m_refitWaste > MAX_REFIT_WASTE * m_builtNodes) {
+        return false;
+    }
+
+    // Root has to keep containing every body, and should not be far larger than needed
+    const Quad& root = m_cells[m_root].quad;
+    double slack = (root.size - bounds.size) * 0.5;
+    if (slack < 0.0 || bounds.size < root.size * 0.5
+        || std::abs(bounds.center.getX() - root.center.getX()) > slack
+        || std::abs(bounds.center.getY() - root.center.getY()) > slack) {
+        return false;
+    }
+
+    // 1. Find bodies that left their leaf cell
+    size_t maxCount = static_cast<size_t>(maxMigrated * n);
+    m_migrated.clear();
+    for (size_t i = 0; i < n; ++i) {
+        const Quad& cell = m_cells[m_bodyLeaf[i]].quad;
+        Vec2 d = bodies[i].getPos() - cell.center;
+        double half = cell.size * 0.5;
+        if (std::abs(d.getX()) > half || std::abs(d.getY()) > half) {
+            m_migrated.push_back(static_cast<uint32_t>(i));
+            if (m_migrated.size() > maxCount) {
+                return false;
+            }
+        }
+    }
+
+    // 2. Unlink them from their old leaves, then insert them again from the root
+    for (uint32_t body : m_migrated) {
+        size_t leaf = m_bodyLeaf[body];
+        uint32_t* link = &m_leafHead[leaf];
+        while (*link != body) {
+            link = &m_bodyNext[*link];
+        }
+        *link = m_bodyNext[body];
+
+        if (m_leafHead[leaf] == m_noBody) {
+            m_nodes[leaf].mass = 0.0f;
+            m_nodes[leaf].children = 0;
+            m_cells[leaf].count = 0;
+        }
+    }
+    for (uint32_t body : m_migrated) {
+        refitInsert(bodies, body, m_root);
+    }
+
+    // 3. Lay the leaves' bodies out contiguously again in depth-first order, which split leaves
+    // appended at the end of m_nodes would break, and refresh every occupied leaf
+    size_t cursor = 0;
+    size_t empty = 0;
+    size_t node = m_root;
+    while (true) {
+        if (m_nodes[node].isBranch()) {
+            node = m_nodes[node].children;
+            continue;
+        }
+
+        uint32_t head = m_leafHead[node];
+        if (head == m_noBody) {
+            empty++;
+        } else {
+            size_t first = cursor;
+            for (uint32_t body = head; body != m_noBody; body = m_bodyNext[body]) {
+                m_order[cursor] = body;
+                m_sortedPos[cursor] = bodies[body].getPos();
+                m_sortedMass[cursor] = bodies[body].getMass();
+                cursor++;
+            }
+            setLeaf(m_nodes[node], m_cells[node], first, cursor);
+        }
+
+        if (m_nodes[node].next == 0) {
+            break;
+        }
+        node = m_nodes[node].next;
+    }
+
+    // Checked by the next refit, so this one still returns a usable tree
+    m_refitWaste = (m_nodes.size() - m_builtNodes) + (empty > m_builtEmpty ? empty - m_builtEmpty : 0);
+    return true;
+}
+
+void Quadtree::refitInsert(const BodyStore& bodies, uint32_t body, size_t node) {
+    Vec2 pos = bodies[body].getPos();
+    while (m_nodes[node].isBranch()) {
+        node = m_nodes[node].children + m_cells[node].quad.findQuadrant(pos);
+    }
+
+    // Room left in the leaf, or a body at exactly the same spot: share the leaf like insert() does
+    uint32_t head = m_leafHead[node];
+    size_t count = 0;
+    for (uint32_t other = head; other != m_noBody; other = m_bodyNext[other]) {
+        count++;
+    }
+
+    if (count < m_leafCapacity || bodies[head].getPos() == pos) {
+        m_bodyNext[body] = head;
+        m_leafHead[node] = body;
+        m_bodyLeaf[body] = node;
+        return;
+    }
+
+    // Otherwise split the leaf and push its bodies one level down
+    m_leafHead[node] = m_noBody;
+    subdivide(node);
+    m_leafHead.resize(m_nodes.size(), m_noBody);
+
+    for (uint32_t other = head; other != m_noBody;) {
+        uint32_t next = m_bodyNext[other];
+        refitInsert(bodies, other, node);
+        other = next;
+    }
+    refitInsert(bodies, body, node);
+}
+
+void Quadtree::reduceChildren(size_t node) {
+    Node& parent = m_nodes[node];
+    const Node* child = &m_nodes[parent.children];
+
+    // Independent lanes per child and pairwise sums keep this vectorizable
+    double m[4], wx[4], wy[4];
+    for (size_t k = 0; k < 4; k++) {
+        m[k] = child[k].mass;
+        wx[k] = child[k].x * m[k];
+        wy[k] = child[k].y * m[k];
+    }
+
+    double mass = (m[0] + m[1]) + (m[2] + m[3]);
+    parent.mass = static_cast<float>(mass);
+
+    // Calculate weighted center of mass
+    if (mass > 0) {
+        parent.x = ((wx[0] + wx[1]) + (wx[2] + wx[3])) / mass;
+        parent.y = ((wy[0] + wy[1]) + (wy[2] + wy[3])) / mass;
+    }
+
+    if (m_quadrupole) {
+        reduceMoments(node);
+    }
+
+    if (m_criterion != OpeningCriterion::Geometric) {
+        // Buckets can be accepted whole, so they need a bmax as well
+        for (size_t k = 0; k < 4; k++) {
+            if (child[k].isBucket()) {
+                setOpeningSize(parent.children + k);
+            }
+        }
+        setOpeningSize(node);
+    }
+}
+
+void Quadtree::setOpeningSize(size_t node) {
+    Node& n = m_nodes[node];
+    const Quad& quad = m_cells[node].quad;
+    double half = quad.size * 0.5;
+    double bx = half + std::abs(n.x - quad.center.getX());
+    double by = half + std::abs(n.y - quad.center.getY());
+    n.sizeSq = static_cast<float>(bx * bx + by * by);
+}
+
+void Quadtree::reduceMoments(size_t node) {
+    const Node& parent = m_nodes[node];
+    Moments total;
+
+    for (size_t k = 0; k < 4; k++) {
+        size_t c = parent.children + k;
+        const Node& child = m_nodes[c];
+
+        // Leaves are only reached through their parent, so their moments are filled in here
+        if (child.isLeaf()) {
+            m_moments[c] = child.isBucket() ? bucketMoments(c) : Moments();
+        }
+        if (child.isEmpty()) continue;
+
+        const Moments& s = m_moments[c];
+        double dx = child.x - parent.x;
+        double dy = child.y - parent.y;
+        total.xx += s.xx + child.mass * dx * dx;
+        total.xy += s.xy + child.mass * dx * dy;
+        total.yy += s.yy + child.mass * dy * dy;
+    }
+
+    m_moments[node] = total;
+}
+
+Moments Quadtree::bucketMoments(size_t node) const {
+    const Node& leaf = m_nodes[node];
+    uint32_t first = leaf.children & ~Node::LEAF_BUCKET;
+    uint32_t count = m_cells[node].count;
+
+    Moments s;
+    for (uint32_t i = first; i < first + count; ++i) {
+        double dx = m_sortedPos[i].getX() - leaf.x;
+        double dy = m_sortedPos[i].getY() - leaf.y;
+        s.xx += m_sortedMass[i] * dx * dx;
+        s.xy += m_sortedMass[i] * dx * dy;
+        s.yy += m_sortedMass[i] * dy * dy;
+    }
+    return s;
+}
+
 void Quadtree::propagate() {
+    if (m_criterion != OpeningCriterion::Geometric && m_nodes[m_root].isBucket()) {
+        setOpeningSize(m_root);
+    }
+    if (m_quadrupole) {
+        m_moments.resize(m_nodes.size());
+        m_moments[m_root] = m_nodes[m_root].isBucket() ? bucketMoments(m_root) : Moments();
+    }
+
     // Iterate through m_parents in reverse order (bottom-up)
     for (auto it = m_parents.rbegin(); it != m_parents.rend(); ++it) {
-        size_t node = *it;
-        size_t i = m_nodes[node].children;
-
-        // Calculate total mass
-        m_nodes[node].mass = m_nodes[i].mass 
-                         + m_nodes[i + 1].mass 
-                         + m_nodes[i + 2].mass 
-                         + m_nodes[i + 3].mass;
-
-        // Calculate weighted center of mass
-        if (m_nodes[node].mass > 0) {
-            m_nodes[node].pos = Vec2(
-                (m_nodes[i].pos.getX() * m_nodes[i].mass +
-                 m_nodes[i + 1].pos.getX() * m_nodes[i + 1].mass +
-                 m_nodes[i + 2].pos.getX() * m_nodes[i + 2].mass +
-                 m_nodes[i + 3].pos.getX() * m_nodes[i + 3].mass) / m_nodes[node].mass,
-                (m_nodes[i].pos.getY() * m_nodes[i].mass +
-                 m_nodes[i + 1].pos.getY() * m_nodes[i + 1].mass +
-                 m_nodes[i + 2].pos.getY() * m_nodes[i + 2].mass +
-                 m_nodes[i + 3].pos.getY() * m_nodes[i + 3].mass) / m_nodes[node].mass
-            );
+        reduceChildren(*it);
+    }
+}
+
+void Quadtree::propagateParallel(ThreadPool& pool, size_t chunks) {
+    if (m_criterion != OpeningCriterion::Geometric && m_nodes[m_root].isBucket()) {
+        setOpeningSize(m_root);
+    }
+    if (m_quadrupole) {
+        m_moments.resize(m_nodes.size());
+        m_moments[m_root] = m_nodes[m_root].isBucket() ? bucketMoments(m_root) : Moments();
+    }
+
+    size_t count = m_parents.size();
+    if (count == 0) return;
+
+    // Levels smaller than this are cheaper to reduce here than to hand to the pool
+    const size_t MIN_PARALLEL_LEVEL = 2048;
+
+    chunks = std::max<size_t>(1, std::min(chunks, count));
+    size_t perChunk = (count + chunks - 1) / chunks;
+    m_parentDepth.resize(count);
+    m_levelParents.resize(count);
+    m_chunkMaxDepth.assign(chunks, 0);
+
+    // 1. Depth of every parent. Sizes halve exactly per level, so the exponent difference is the depth
+    int rootExp = std::ilogb(m_cells[m_root].quad.size);
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t start = c * perChunk;
+        size_t end = std::min(start + perChunk, count);
+        if (start >= end) break;
+
+        pool.enqueue([this, c, start, end, rootExp]() {
+            uint32_t maxDepth = 0;
+            for (size_t i = start; i < end; ++i) {
+                uint32_t depth = static_cast<uint32_t>(rootExp - std::ilogb(m_cells[m_parents[i]].quad.size));
+                m_parentDepth[i] = depth;
+                maxDepth = std::max(maxDepth, depth);
+            }
+            m_chunkMaxDepth[c] = maxDepth;
+        });
+    }
+    pool.wait();
+
+    size_t levels = *std::max_element(m_chunkMaxDepth.begin(), m_chunkMaxDepth.end()) + 1;
+    m_levelCounts.assign(chunks * levels, 0);
+
+    // 2. Per-chunk histograms of depth
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t start = c * perChunk;
+        size_t end = std::min(start + perChunk, count);
+        if (start >= end) break;
+
+        pool.enqueue([this, c, start, end, levels]() {
+            size_t* counts = &m_levelCounts[c * levels];
+            for (size_t i = start; i < end; ++i) {
+                counts[m_parentDepth[i]]++;
+            }
+        });
+    }
+    pool.wait();
+
+    // 3. Prefix sum, level-major so each level is one contiguous range
+    m_levelStart.resize(levels + 1);
+    size_t total = 0;
+    for (size_t level = 0; level < levels; ++level) {
+        m_levelStart[level] = total;
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t levelCount = m_levelCounts[c * levels + level];
+            m_levelCounts[c * levels + level] = total;
+            total += levelCount;
+        }
+    }
+    m_levelStart[levels] = total;
+
+    // 4. Scatter parents into their level
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t start = c * perChunk;
+        size_t end = std::min(start + perChunk, count);
+        if (start >= end) break;
+
+        pool.enqueue([this, c, start, end, levels]() {
+            size_t* offsets = &m_levelCounts[c * levels];
+            for (size_t i = start; i < end; ++i) {
+                m_levelParents[offsets[m_parentDepth[i]]++] = m_parents[i];
+            }
+        });
+    }
+    pool.wait();
+
+    // 5. Reduce bottom-up, a level only reads children finished in the level below
+    for (size_t level = levels; level-- > 0;) {
+        size_t first = m_levelStart[level];
+        size_t last = m_levelStart[level + 1];
+
+        if (last - first < MIN_PARALLEL_LEVEL) {
+            for (size_t i = first; i < last; ++i) {
+                reduceChildren(m_levelParents[i]);
+            }
+            continue;
         }
+
+        size_t perTask = (last - first + chunks - 1) / chunks;
+        for (size_t start = first; start < last; start += perTask) {
+            size_t end = std::min(start + perTask, last);
+            pool.enqueue([this, start, end]() {
+                for (size_t i = start; i < end; ++i) {
+                    reduceChildren(m_levelParents[i]);
+                }
+            });
+        }
+        pool.wait();
     }
 }
 
-Vec2 Quadtree::acc(Vec2 pos) const {
+inline void Quadtree::addPointMass(Vec2& acceleration, Vec2 d, double mass) const {
+    ::addPointMass(acceleration, d, mass, m_epsilonsq);
+}
+
+inline void Quadtree::addQuadrupole(Vec2& acceleration, Vec2 d, const Moments& s) const {
+    // Traceless quadrupole of a planar distribution; the z terms drop out for points in the plane
+    double qxx = 2.0 * s.xx - s.yy;
+    double qyy = 2.0 * s.yy - s.xx;
+    double qxy = 3.0 * s.xy;
+
+    double r_sq = d.magSqrd() + m_epsilonsq;
+    double inv_r5 = 1.0 / (r_sq * r_sq * std::sqrt(r_sq));
+    double inv_r7 = inv_r5 / r_sq;
+
+    Vec2 qd(qxx * d.getX() + qxy * d.getY(), qxy * d.getX() + qyy * d.getY());
+    double dqd = d.dot(qd);
+
+    // a = G * (-Q.d / r^5 + 5/2 (d.Q.d) d / r^7), d pointing from the body to the center of mass
+    acceleration += (d * (2.5 * dqd * inv_r7) - qd * inv_r5) * GC;
+}
+
+Vec2 Quadtree::acc(Vec2 pos, double accMag, uint32_t* interactions) const {
     Vec2 acceleration(0, 0);
+    uint32_t summed = 0;
+    double tolerance = accTolerance(accMag);
 
     size_t node = m_root;
     while (true) {
         const Node& n = m_nodes[node];
 
-        if (n.mass == 0.0) {
+        if (n.mass == 0.0f) {
             if (n.next == 0) {
                 break;
             }
@@ -189,46 +869,344 @@ Vec2 Quadtree::acc(Vec2 pos) const {
         }
 
         Vec2 d = Vec2(
-            n.pos.getX() - pos.getX(),
-            n.pos.getY() - pos.getY()
+            n.x - pos.getX(),
+            n.y - pos.getY()
         );
         double d_sq = d.magSqrd();
+        bool far = isFar(n, d_sq, tolerance);
 
-        // Check if we can treat this node as a single body (leaf or far enough)
-        if (n.isLeaf() || n.quad.size * n.quad.size < d_sq * m_thetasq) {
-            // Skip if this is the body itself (d_sq very small)
-            if (d_sq > m_epsilonsq) {  // Only calculate if not too close
-                double denom = (d_sq + m_epsilonsq) * std::sqrt(d_sq + m_epsilonsq);
-                
-                if (denom > 0) {
-                    double forceMag = GC * n.mass / denom;
-                    forceMag = std::min(forceMag, 1e10);
-                    acceleration += d * forceMag;
-                }
+        if (n.isBucket() && !far) {
+            // Too close to treat the bucket as one mass, sum its bodies directly
+            uint32_t first = n.children & ~Node::LEAF_BUCKET;
+            uint32_t count = m_cells[node].count;
+            const Vec2* leafPos = &m_sortedPos[first];
+            const double* leafMass = &m_sortedMass[first];
+            for (uint32_t i = 0; i < count; ++i) {
+                addPointMass(acceleration, leafPos[i] - pos, leafMass[i]);
             }
-
-            if (n.next == 0) {
-                break;
+            summed += count;
+        } else if (n.isLeaf() || far) {
+            // Treat this node as a single body (single-body leaf or far enough)
+            addPointMass(acceleration, d, n.mass);
+            summed++;
+            if (m_quadrupole && n.children != 0) {
+                addQuadrupole(acceleration, d, m_moments[node]);
             }
-            node = n.next;
         } else {
             node = n.children;
+            continue;
+        }
+
+        if (n.next == 0) {
+            break;
+        }
+        node = n.next;
+    }
+
+    if (interactions) *interactions = summed;
+    return acceleration;
+}
+
+// Splits the tree into groups walked once for all their bodies.
+void Quadtree::buildGroups(size_t maxBodies) {
+    maxBodies = std::max<size_t>(maxBodies, 1);
+
+    // Cached lists belong to their group, so keep the groups while the lists can still be used
+    if (m_listSkin > 0.0 && m_hasBodyOrder && m_groupsVersion == m_topologyVersion
+        && m_groupsMaxBodies == maxBodies && !m_groups.empty()) {
+        return;
+    }
+
+    m_groups.clear();
+    m_groupInteractions.clear();
+    m_groupsVersion = m_topologyVersion;
+    m_groupsMaxBodies = maxBodies;
+    if (!m_hasBodyOrder) return;
+
+    size_t count = collectGroups(m_root, maxBodies);
+    if (count > 0 && (count <= maxBodies || m_nodes[m_root].isLeaf())) {
+        m_groups.push_back(m_root);
+    }
+
+    m_groupInteractions.assign(m_groups.size(), 0);
+    if (m_listSkin > 0.0) {
+        m_groupLists.resize(m_groups.size());
+        for (GroupList& cached : m_groupLists) {
+            cached.version = 0;
+        }
+    }
+}
+
+size_t Quadtree::collectGroups(size_t node, size_t maxBodies) {
+    const Node& n = m_nodes[node];
+    if (n.isLeaf()) {
+        return m_cells[node].count;
+    }
+
+    std::array<size_t, 4> counts;
+    size_t total = 0;
+    for (size_t k = 0; k < 4; ++k) {
+        counts[k] = collectGroups(n.children + k, maxBodies);
+        total += counts[k];
+    }
+
+    // Too big to be one group, so every child that still fits (or cannot be split) becomes one
+    if (total > maxBodies) {
+        for (size_t k = 0; k < 4; ++k) {
+            size_t child = n.children + k;
+            if (counts[k] > 0 && (counts[k] <= maxBodies || m_nodes[child].isLeaf())) {
+                m_groups.push_back(static_cast<uint32_t>(child));
+            }
+        }
+    }
+    return total;
+}
+
+void Quadtree::accGroup(size_t group, BodyStore& bodies, InteractionList& list) {
+    list.clear();
+
+    // 1. The group's bodies and their bounding box
+    uint32_t groupNode = m_groups[group];
+    uint32_t end = m_nodes[groupNode].next;
+    double minX = std::numeric_limits<double>::max();
+    double minY = minX;
+    double maxX = std::numeric_limits<double>::lowest();
+    double maxY = maxX;
+
+    size_t node = groupNode;
+    while (true) {
+        const Node& n = m_nodes[node];
+        if (n.isBranch()) {
+            node = n.children;
+            continue;
+        }
+
+        const Cell& cell = m_cells[node];
+        for (uint32_t i = cell.first; i < cell.first + cell.count; ++i) {
+            list.members.push_back(i);
+            minX = std::min(minX, m_sortedPos[i].getX());
+            maxX = std::max(maxX, m_sortedPos[i].getX());
+            minY = std::min(minY, m_sortedPos[i].getY());
+            maxY = std::max(maxY, m_sortedPos[i].getY());
+        }
+
+        node = n.next;
+        if (node == end) break;
+    }
+
+    // Refit may have moved every body out of the group
+    m_groupInteractions[group] = 0;
+    if (list.members.empty()) return;
+
+    // 2. One walk for the whole box, far from its nearest point means far from every body inside.
+    // The body pulled least sets the tolerance, so no body gets a looser test than on its own
+    double accMag = std::numeric_limits<double>::max();
+    if (m_criterion == OpeningCriterion::RelativeAccuracy) {
+        for (uint32_t slot : list.members) {
+            accMag = std::min(accMag, std::sqrt(bodies[m_order[slot]].getAcc().magSqrd()));
         }
     }
 
+    if (m_listSkin > 0.0) {
+        // Every opening decision of the cached walk holds anywhere inside its padded box, as long
+        // as its far nodes, which refit may have moved, still pass the test from there
+        GroupList& cached = m_groupLists[group];
+        double tolerance = accTolerance(accMag);
+        cached.reused = cached.version == m_topologyVersion && cached.age < m_maxListAge
+            && minX >= cached.minX && maxX <= cached.maxX && minY >= cached.minY && maxY <= cached.maxY
+            && cachedFarHolds(cached, tolerance);
+
+        if (cached.reused) {
+            cached.age++;
+            collectCached(cached, list);
+        } else {
+            double skin = m_listSkin * m_cells[groupNode].quad.size;
+            cached.far.clear();
+            cached.near.clear();
+            cached.minX = minX - skin;
+            cached.minY = minY - skin;
+            cached.maxX = maxX + skin;
+            cached.maxY = maxY + skin;
+            cached.version = m_topologyVersion;
+            cached.age = 0;
+            collectInteractions(cached.minX, cached.minY, cached.maxX, cached.maxY, tolerance, list, &cached);
+        }
+    } else {
+        collectInteractions(minX, minY, maxX, maxY, accTolerance(accMag), list);
+    }
+
+    // 3. Apply the shared list to every body of the group
+    for (uint32_t slot : list.members) {
+        bodies[m_order[slot]].setAcc(evaluate(list, m_sortedPos[slot]));
+    }
+    m_groupInteractions[group] = static_cast<uint64_t>(list.count + list.farCount) * list.members.size();
+}
+
+Vec2 Quadtree::acc(Vec2 pos, InteractionList& list, double accMag, uint32_t* interactions) const {
+    list.clear();
+    collectInteractions(pos.getX(), pos.getY(), pos.getX(), pos.getY(), accTolerance(accMag), list);
+    if (interactions) *interactions = static_cast<uint32_t>(list.count + list.farCount);
+    return evaluate(list, pos);
+}
+
+Vec2 Quadtree::evaluate(const InteractionList& list, Vec2 pos) const {
+    Vec2 acceleration = sumPointMasses(list.x.data(), list.y.data(), list.mass.data(), list.count,
+                                       pos.getX(), pos.getY(), m_epsilonsq);
+    if (list.farCount > 0) {
+        acceleration += sumPointMassesFloat(list.farX.data(), list.farY.data(), list.farMass.data(), list.farCount,
+                                            static_cast<float>(pos.getX() - list.originX),
+                                            static_cast<float>(pos.getY() - list.originY),
+                                            static_cast<float>(m_epsilonsq));
+    }
+    for (uint32_t q : list.quadrupoles) {
+        addQuadrupole(acceleration, m_nodes[q].getPos() - pos, m_moments[q]);
+    }
     return acceleration;
 }
 
+void Quadtree::collectInteractions(double minX, double minY, double maxX, double maxY, double accTolerance,
+                                   InteractionList& list, GroupList* record) const {
+    list.originX = 0.5 * (minX + maxX);
+    list.originY = 0.5 * (minY + maxY);
+
+    size_t node = m_root;
+    while (true) {
+        const Node& n = m_nodes[node];
+
+        if (n.mass != 0.0f) {
+            double dx = std::max(std::max(minX - n.x, n.x - maxX), 0.0);
+            double dy = std::max(std::max(minY - n.y, n.y - maxY), 0.0);
+            bool far = isFar(n, dx * dx + dy * dy, accTolerance);
+
+            if (n.isLeaf() && !far) {
+                // Bodies of nearby leaves are summed exactly
+                addBodies(node, list);
+                if (record) record->near.push_back(static_cast<uint32_t>(node));
+            } else if (far) {
+                addNode(node, list);
+                if (record) record->far.push_back(static_cast<uint32_t>(node));
+            } else {
+                node = n.children;
+                continue;
+            }
+        } else if (record) {
+            // A body may move into an empty cell later, which the cached list must still cover
+            record->near.push_back(static_cast<uint32_t>(node));
+        }
+
+        if (n.next == 0) {
+            break;
+        }
+        node = n.next;
+    }
+}
+
+void Quadtree::collectCached(const GroupList& cached, InteractionList& list) const {
+    list.originX = 0.5 * (cached.minX + cached.maxX);
+    list.originY = 0.5 * (cached.minY + cached.maxY);
+
+    for (uint32_t node : cached.far) {
+        if (!m_nodes[node].isEmpty()) {
+            addNode(node, list);
+        }
+    }
+    for (uint32_t node : cached.near) {
+        addBodies(node, list);
+    }
+}
+
+bool Quadtree::cachedFarHolds(const GroupList& cached, double accTolerance) const {
+    for (uint32_t node : cached.far) {
+        const Node& n = m_nodes[node];
+        if (n.isEmpty()) continue;
+
+        double dx = std::max(std::max(cached.minX - n.x, n.x - cached.maxX), 0.0);
+        double dy = std::max(std::max(cached.minY - n.y, n.y - cached.maxY), 0.0);
+        if (!isFar(n, dx * dx + dy * dy, accTolerance)) return false;
+    }
+    return true;
+}
+
+void Quadtree::addNode(size_t node, InteractionList& list) const {
+    const Node& n = m_nodes[node];
+
+    // Single bodies stay exact, only real cells may go to the float list
+    if (m_mixedPrecision && n.children != 0) {
+        list.addFar(n.x, n.y, n.mass);
+    } else {
+        list.addPoint(n.x, n.y, n.mass);
+    }
+    if (m_quadrupole && n.children != 0) {
+        list.quadrupoles.push_back(static_cast<uint32_t>(node));
+    }
+}
+
+void Quadtree::addBodies(size_t node, InteractionList& list) const {
+    // A leaf is usually a subtree of one node, but a cached leaf may have been split by refit
+    uint32_t end = m_nodes[node].next;
+    while (true) {
+        const Node& n = m_nodes[node];
+        if (n.isBranch()) {
+            node = n.children;
+            continue;
+        }
+
+        if (n.isBucket()) {
+            uint32_t first = n.children & ~Node::LEAF_BUCKET;
+            uint32_t count = m_cells[node].count;
+            for (uint32_t i = first; i < first + count; ++i) {
+                list.addPoint(m_sortedPos[i].getX(), m_sortedPos[i].getY(), m_sortedMass[i]);
+            }
+        } else if (!n.isEmpty()) {
+            list.addPoint(n.x, n.y, n.mass);
+        }
+
+        node = n.next;
+        if (node == end) break;
+    }
+}
+
+void Quadtree::setListSkin(double skin) {
+    m_listSkin = std::max(skin, 0.0);
+    m_groupsVersion = 0;
+
+    // The groups may have been built without a skin, keep one (unwalked) list per group
+    m_groupLists.resize(m_groups.size());
+    for (GroupList& cached : m_groupLists) {
+        cached.version = 0;
+        cached.reused = false;
+    }
+}
+
+double Quadtree::getListReuseRate() const {
+    if (m_listSkin <= 0.0 || m_groups.empty()) return 0.0;
+
+    size_t reused = 0;
+    for (size_t g = 0; g < m_groups.size() && g < m_groupLists.size(); ++g) {
+        if (m_groupLists[g].reused) reused++;
+    }
+    return static_cast<double>(reused) / m_groups.size();
+}
+
+double Quadtree::getGroupInteractionsPerBody() const {
+    uint64_t total = 0;
+    for (uint64_t interactions : m_groupInteractions) {
+        total += interactions;
+    }
+    return m_order.empty() ? 0.0 : static_cast<double>(total) / m_order.size();
+}
+
 // Renders the quadtree wireframe.
 void Quadtree::render() const
 {
-    for (const auto& node : m_nodes) {
-        if( !node.isEmpty() ) {
+    for (size_t i = 0; i < m_nodes.size(); ++i) {
+        if( !m_nodes[i].isEmpty() ) {
             // Convert from world space (AU) to screen space (pixels)
             // Same transformation as Body::draw()
-            float screenX = WINDOW_WIDTH / 2.0f + static_cast<float>(node.quad.center.getX() * SCALE);
-            float screenY = WINDOW_HEIGHT / 2.0f + static_cast<float>(node.quad.center.getY() * SCALE);
-            float screenSize = static_cast<float>(node.quad.size * SCALE);
+            const Quad& quad = m_cells[i].quad;
+            float screenX = WINDOW_WIDTH / 2.0f + static_cast<float>(quad.center.getX() * SCALE);
+            float screenY = WINDOW_HEIGHT / 2.0f + static_cast<float>(quad.center.getY() * SCALE);
+            float screenSize = static_cast<float>(quad.size * SCALE);
             
             DrawRectangleLinesEx(
                 Rectangle{
@@ -250,4 +1228,21 @@ double Quadtree::getTheta() const {
 
 void Quadtree::setTheta(double theta) {
     m_thetasq = theta * theta;
+    m_accScale = relativeAccuracyScale(theta);
+}
+
+void Quadtree::setOpeningCriterion(OpeningCriterion criterion) {
+    if (criterion == OpeningCriterion::Geometric && m_criterion != criterion) {
+        m_leavesIndexed = false;
+    }
+    m_criterion = criterion;
+}
+
+void Quadtree::setLeafCapacity(size_t capacity) {
+    m_leafCapacity = std::max<size_t>(capacity, 1);
+    m_leavesIndexed = false;
+}
+
+void Quadtree::setSplitLevels(int levels) {
+    m_splitLevels = std::min(std::max(levels, 1), 6);
 }
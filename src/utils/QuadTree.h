@@ -7,9 +7,14 @@
 #include <limits>
 #include "constants.h"
 #include "Vec.h"
+#include "Morton.h"
+#include "BatchMath.h"
+#include "ForceKernel.h"
 #include "raylib.h"
+#include "FirstTouch.h"
+#include "../headers/ThreadPool.h"
 
-class Body;
+class BodyStore;
 
 // Represents a quadrant in 2D space
 struct Quad {
@@ -20,7 +25,10 @@ struct Quad {
     Quad(Vec2 center, double size) : center(center), size(size) {}
 
     // Create a quad containing all bodies
-    static Quad newContaining(const std::vector<Body>& bodies);
+    static Quad newContaining(const BodyStore& bodies);
+
+    // Padded square around a box, the same quad newContaining makes for bodies with these bounds
+    static Quad containing(const Bounds& bounds);
 
     // Find which quadrant (0-3) a position belongs to
     // 0: bottom-left, 1: bottom-right, 2: top-left, 3: top-right
@@ -31,36 +39,320 @@ struct Quad {
 
     // Subdivide into 4 child quads
     std::array<Quad, 4> subdivide() const;
+
+    // Morton key of a position inside this quad, quantized to MORTON_LEVELS levels
+    uint64_t mortonKey(Vec2 pos) const;
+
+    // Hilbert curve distance of a position inside this quad, on the same grid as mortonKey
+    uint64_t hilbertKey(Vec2 pos) const;
+
+    // Cell of a position on the 2^MORTON_LEVELS grid both keys use, clamped to the quad
+    void gridCell(Vec2 pos, uint32_t& x, uint32_t& y) const;
+};
+
+// Strategy used to build the tree each step
+enum class TreeBuilder {
+    Insertion, // One Quadtree::insert descent per body
+    Morton,    // Radix sort bodies by Morton key, then emit the tree in one pass
+    Parallel,  // Morton build split into 4^k subtrees built on the thread pool
+    Refit      // Keep last step's topology and only move bodies that left their leaf
 };
 
-// Node in the quadtree
-struct Node {
-    size_t children;  // Index of first child (0 if leaf)
-    size_t next;      // Index of next node at same level
-    Vec2 pos;         // Center of mass position
-    double mass;      // Total mass
-    Quad quad;        // Spatial region
+// Test deciding whether a node is far enough from a body to act as one mass
+enum class OpeningCriterion {
+    Geometric,        // size < theta * d
+    Bmax,             // bmax < theta * d, bmax being the distance from the center of mass to the
+                      // cell's farthest corner, so lopsided cells are opened sooner
+    RelativeAccuracy  // G * M * bmax^2 / d^4 < 0.027 * theta^3.5 * |a|, using the body's acceleration
+                      // from the last step: the node's error estimate has to be small next to the
+                      // body's total pull, so light cells open late and cells near heavy ones early.
+                      // 0.027 and 3.5 are an empirical fit to this repo's disk presets (2k-5k bodies
+                      // around a central mass), where the RMS force error then matches Geometric's at
+                      // the same theta for theta 0.2-0.7. Other distributions will differ, disks
+                      // without a central mass come out more accurate. Above theta 0.7 the error
+                      // levels off near 0.5%, as a cell is still opened while the body is inside
+                      // its bmax.
+                      // Falls back to Bmax while a body has no acceleration yet
+};
+
+// Node in the quadtree, split into the hot part walked by Quadtree::acc and the cold
+// geometry only the builders need. Both arrays share the same index.
+
+// Hot traversal data, 32 bytes so two nodes share a cache line
+struct alignas(32) Node {
+    double x;           // Center of mass position
+    double y;
+    float mass;         // Total mass
+    float sizeSq;       // Squared opening size: side length of the quad, or bmax for the criteria using it
+    uint32_t children;  // Index of first child (0 if leaf, LEAF_BUCKET | first body for bucket leaves)
+    uint32_t next;      // Index of next node at same level
+
+    // Marks a leaf holding several bodies, the low bits index its first body in the sorted arrays
+    static constexpr uint32_t LEAF_BUCKET = 0x80000000u;
+
+    Node() : Node(0, 0.0) {}
+    Node(uint32_t next, double size)
+        : x(0), y(0), mass(0.0f), sizeSq(static_cast<float>(size * size)), children(0), next(next) {}
 
-    Node(size_t next, Quad quad) 
-        : children(0), next(next), pos(Vec2(0, 0)), mass(0.0), quad(quad) {}
+    bool isLeaf() const { return children == 0 || (children & LEAF_BUCKET) != 0; }
+    bool isBranch() const { return !isLeaf(); }
+    bool isBucket() const { return (children & LEAF_BUCKET) != 0; }
+    bool isEmpty() const { return mass == 0.0f; }
 
-    bool isLeaf() const { return children == 0; }
-    bool isBranch() const { return children != 0; }
-    bool isEmpty() const { return mass == 0.0; }
+    Vec2 getPos() const { return Vec2(x, y); }
+    void setPos(Vec2 pos) { x = pos.getX(); y = pos.getY(); }
+};
+static_assert(sizeof(Node) == 32, "Node should stay half a cache line");
+
+// Second moments of a node's mass about its center of mass, enough to form its quadrupole
+struct Moments {
+    double xx = 0.0;
+    double xy = 0.0;
+    double yy = 0.0;
+};
+
+// Cold build-only data
+struct Cell {
+    Quad quad;          // Spatial region
+    uint32_t first;     // Leaf bodies in the tree's sorted body arrays (Morton builders only)
+    uint32_t count;
+
+    Cell() : Cell(Quad()) {}
+    Cell(Quad quad) : quad(quad), first(0), count(0) {}
+};
+
+// Interactions one tree walk accepted for a group of bodies, kept per thread and reused
+struct InteractionList {
+    // Point masses (accepted nodes and bodies of nearby leaves) as separate arrays for the
+    // force kernel. Only the first count entries are used, the arrays only ever grow
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> mass;
+    size_t count = 0;
+
+    // Accepted far nodes in mixed precision mode, as float offsets from (originX, originY)
+    std::vector<float> farX;
+    std::vector<float> farY;
+    std::vector<float> farMass;
+    size_t farCount = 0;
+    double originX = 0.0;
+    double originY = 0.0;
+
+    std::vector<uint32_t> quadrupoles;  // Accepted nodes whose quadrupole term applies too
+    std::vector<uint32_t> members;      // Sorted slots of the group's own bodies
+
+    void clear() {
+        count = 0;
+        farCount = 0;
+        quadrupoles.clear();
+        members.clear();
+    }
+
+    void addPoint(double px, double py, double m) {
+        append(x, y, mass, count, px, py, m);
+    }
+
+    void addFar(double px, double py, double m) {
+        append(farX, farY, farMass, farCount,
+               static_cast<float>(px - originX), static_cast<float>(py - originY), static_cast<float>(m));
+    }
+
+private:
+    template <typename T>
+    static void append(std::vector<T>& xs, std::vector<T>& ys, std::vector<T>& ms, size_t& n, T px, T py, T m) {
+        if (n == xs.size()) {
+            size_t grown = std::max<size_t>(256, xs.size() * 2);
+            xs.resize(grown);
+            ys.resize(grown);
+            ms.resize(grown);
+        }
+        xs[n] = px;
+        ys[n] = py;
+        ms[n] = m;
+        n++;
+    }
 };
 
 // Barnes-Hut Quadtree for efficient force calculation
 class Quadtree {
 private:
+    // One independently built piece of the tree for the parallel builder
+    struct Subtree {
+        size_t root = 0;                // Node in m_nodes this subtree hangs from
+        size_t first = 0;               // Range of sorted bodies it holds
+        size_t last = 0;
+        std::vector<Node> nodes;        // Local nodes, index 0 stands in for root
+        std::vector<Cell> cells;
+        std::vector<size_t> parents;    // Local parents in pre-order
+        size_t nodeOffset = 0;          // Where nodes[1..] land in m_nodes
+        size_t parentOffset = 0;        // Where parents land in m_parents
+    };
+
+    // Node storage a build writes into: the tree itself or one parallel subtree
+    struct NodeBuffer {
+        std::vector<Node>& nodes;
+        std::vector<Cell>& cells;
+        std::vector<size_t>& parents;
+    };
+
     double m_thetasq;    // Theta squared (accuracy parameter)
+    double m_accScale;   // Factor of |a| in the RelativeAccuracy tolerance, from theta
+    OpeningCriterion m_criterion = OpeningCriterion::Geometric;
     double m_epsilonsq;    // Epsilon squared (softening parameter)
     std::vector<Node> m_nodes;
+    std::vector<Cell> m_cells;
     std::vector<size_t> m_parents;
 
+    // Bodies in leaf order, each leaf owns a contiguous range of up to m_leafCapacity entries
+    size_t m_leafCapacity;
+    std::vector<Vec2> m_sortedPos;
+    FieldVector<double> m_sortedMass;
+
+    // Sum accepted far nodes in float in the batched paths
+    bool m_mixedPrecision = false;
+
+    // Optional quadrupole terms, filled by propagation and indexed like m_nodes
+    bool m_quadrupole;
+    std::vector<Moments> m_moments;
+
+    // Scratch buffers for the Morton builder, kept to avoid per-frame allocations
+    FieldVector<uint64_t> m_keys;
+    FieldVector<uint32_t> m_order;
+    FieldVector<uint64_t> m_keyScratch;
+    FieldVector<uint32_t> m_orderScratch;
+
+    // Parallel builder state, also reused between frames
+    int m_splitLevels;                  // Root is split into 4^m_splitLevels subtrees
+    std::vector<size_t> m_bucketStart;  // First sorted body of each top-level cell
+    std::vector<size_t> m_chunkCounts;  // Per-chunk bucket histograms
+    std::vector<Subtree> m_subtrees;
+    size_t m_subtreeCount = 0;
+
+    // Parents grouped by depth for level-parallel propagation
+    std::vector<uint32_t> m_parentDepth;
+    std::vector<size_t> m_levelParents;
+    std::vector<size_t> m_levelStart;
+    std::vector<size_t> m_levelCounts;  // Per-chunk depth histograms
+    std::vector<uint32_t> m_chunkMaxDepth;
+
+    // Body <-> leaf index used by refit(). Leaves keep a singly linked list of their bodies
+    FieldVector<size_t> m_sortedLeaf;   // Leaf of each sorted body, written by the Morton builders
+    std::vector<size_t> m_bodyLeaf;     // Leaf of each body
+    std::vector<uint32_t> m_bodyNext;   // Next body in the same leaf
+    std::vector<uint32_t> m_leafHead;   // First body of each node (m_noBody if none)
+    std::vector<uint32_t> m_migrated;   // Bodies that crossed a cell boundary this step
+    bool m_leavesIndexed = false;
+    size_t m_builtNodes = 0;            // Nodes of the full build indexLeaves() ran on
+    size_t m_builtEmpty = 0;            // Empty leaves of that build
+    size_t m_refitWaste = 0;            // Nodes refits have appended and leaves they emptied since
+
+    // Whether leaf ranges and m_order describe the current bodies (false after insert())
+    bool m_hasBodyOrder = false;
+
+    // Nodes that are walked once for all their bodies, see buildGroups()
+    std::vector<uint32_t> m_groups;
+    std::vector<uint64_t> m_groupInteractions; // List size times body count of each group's last accGroup
+
+    // What a group's last walk accepted, kept while the tree keeps its topology
+    struct GroupList {
+        std::vector<uint32_t> far;      // Nodes that passed the opening test, used as one mass
+        std::vector<uint32_t> near;     // Leaves summed body by body, including empty ones and
+                                        // ones that have split since
+        double minX = 0.0;              // Padded box the walk was made for
+        double minY = 0.0;
+        double maxX = 0.0;
+        double maxY = 0.0;
+        uint64_t version = 0;           // m_topologyVersion of the walk, 0 if never walked
+        uint32_t age = 0;               // Steps the list has been reused since its walk
+        bool reused = false;            // Whether the last accGroup skipped the walk
+    };
+
+    double m_listSkin = 0.0;            // Padding of a cached walk's box, as a fraction of the group's cell
+    std::vector<GroupList> m_groupLists;
+    uint64_t m_topologyVersion = 0;     // Bumped by every full build; refit keeps existing nodes where they are
+    uint64_t m_groupsVersion = 0;       // Topology m_groups was made for
+    size_t m_groupsMaxBodies = 0;
+    static constexpr uint32_t m_maxListAge = 16; // Steps a cached list is reused before it is walked again
+
     static constexpr size_t m_root = 0;
+    static constexpr uint32_t m_noBody = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t m_openNext = std::numeric_limits<uint32_t>::max(); // Placeholder next link inside a subtree
 
     // Subdivide a node into 4 children
     size_t subdivide(size_t node);
+    static size_t subdivide(NodeBuffer out, size_t node);
+
+    // Emit the subtree for sorted bodies [first, last) into node at the given depth
+    void emitMorton(NodeBuffer out, size_t node, size_t first, size_t last, int level);
+
+    // Copy position and mass of sorted bodies [first, last) into the leaf arrays
+    void gatherSorted(const BodyStore& bodies, size_t first, size_t last);
+
+    // Make node a leaf over sorted bodies [first, last) with their total mass and center of mass
+    void setLeaf(Node& node, Cell& cell, size_t first, size_t last);
+
+    // Serially emit the top levels of the parallel build, queueing subtrees at m_splitLevels
+    void emitTopLevels(const BodyStore& bodies, size_t node, size_t bucket, int level);
+
+    // Copy a finished subtree into m_nodes / m_parents at its offsets
+    void stitchSubtree(const Subtree& subtree);
+
+    // Set a branch's mass and center of mass from its four children
+    void reduceChildren(size_t node);
+
+    // Store the node's bmax in sizeSq, from its cell and center of mass
+    void setOpeningSize(size_t node);
+
+    // Whether a node at squared distance d_sq may be used as one mass. accTolerance is
+    // m_accScale * |a| for the relative criterion and 0 for the size-based ones
+    bool isFar(const Node& n, double d_sq, double accTolerance) const {
+        return isFarCell(n.sizeSq, n.mass, d_sq, m_thetasq, accTolerance);
+    }
+
+    // accTolerance for a sink whose last acceleration had magnitude accMag
+    double accTolerance(double accMag) const {
+        return m_criterion == OpeningCriterion::RelativeAccuracy ? m_accScale * accMag : 0.0;
+    }
+
+    // Set a branch's second moments from its children (parallel axis theorem)
+    void reduceMoments(size_t node);
+
+    // Second moments of the bodies in a bucket leaf
+    Moments bucketMoments(size_t node) const;
+
+    // Collect the interactions of every point inside the box [minX, maxX] x [minY, maxY].
+    // A node is accepted when it is far from the box's nearest point
+    // If record is given, the accepted nodes are also stored there for reuse
+    void collectInteractions(double minX, double minY, double maxX, double maxY, double accTolerance,
+                             InteractionList& list, GroupList* record = nullptr) const;
+
+    // Fill list from a group's cached walk using the nodes' current masses and centers of mass
+    void collectCached(const GroupList& cached, InteractionList& list) const;
+
+    // Whether every far node of a cached walk still passes the opening test from its box. Refit
+    // moves centers of mass and changes masses and bmax without starting a new topology
+    bool cachedFarHolds(const GroupList& cached, double accTolerance) const;
+
+    // Add an accepted node as one mass
+    void addNode(size_t node, InteractionList& list) const;
+
+    // Add every body under node one by one
+    void addBodies(size_t node, InteractionList& list) const;
+
+    // Sum a collected list at pos with the batched force kernel
+    Vec2 evaluate(const InteractionList& list, Vec2 pos) const;
+
+    // Body count of node's subtree, recording subtrees of at most maxBodies as groups
+    size_t collectGroups(size_t node, size_t maxBodies);
+
+    // Link a body into the leaf under node that contains it, splitting the leaf if needed
+    void refitInsert(const BodyStore& bodies, uint32_t body, size_t node);
+
+    // Add the softened pull of a point mass at offset d
+    void addPointMass(Vec2& acceleration, Vec2 d, double mass) const;
+
+    // Add the quadrupole correction of a node whose center of mass is at offset d
+    void addQuadrupole(Vec2& acceleration, Vec2 d, const Moments& moments) const;
 
 public:
     Quadtree(double theta, double epsilon);
@@ -74,17 +366,116 @@ public:
     // Insert a body into the tree
     void insert(Vec2 pos, double mass);
 
+    // Clear the tree and rebuild it from Morton-sorted bodies (replaces clear + insert loop)
+    void buildMorton(const BodyStore& bodies, Quad quad);
+
+    // Same tree as buildMorton, with keys, bucketing, subtrees and stitching spread over the pool.
+    // chunks is how many ranges the per-body passes are split into (usually the thread count)
+    void buildParallel(const BodyStore& bodies, Quad quad, ThreadPool& pool, size_t chunks);
+
+    // Record which leaf holds each body after buildMorton/buildParallel so refit() can be used
+    void indexLeaves();
+
+    // Update the tree built last step to new body positions, moving only bodies that left their
+    // leaf. Bodies are laid out in depth-first tree order, as the builders leave them. Returns
+    // false without touching the tree when a full rebuild is needed instead: the leaves are not
+    // indexed, the body count changed, bounds no longer fits the root (or fills less than half
+    // of it), earlier refits appended or emptied too many nodes, or more than maxMigrated of the
+    // bodies changed leaf. Call propagate() afterwards as with the builders.
+    bool refit(const BodyStore& bodies, Quad bounds, double maxMigrated);
+
     // Propagate mass and center of mass up the tree
     void propagate();
 
-    // Calculate acceleration at a position
-    Vec2 acc(Vec2 pos) const;
+    // Same result as propagate(), but every level is reduced in parallel on the pool,
+    // deepest level first. chunks is how many tasks a level is split into
+    void propagateParallel(ThreadPool& pool, size_t chunks);
+
+    // Calculate acceleration at a position. accMag is the magnitude of the body's acceleration
+    // last step, only used by OpeningCriterion::RelativeAccuracy (0 if unknown). If interactions
+    // is given, it is set to the number of point masses summed, the cost of the walk
+    Vec2 acc(Vec2 pos, double accMag = 0.0, uint32_t* interactions = nullptr) const;
+
+    // Same walk as acc(pos), but it only collects the interactions into list and sums them
+    // afterwards with the vectorized kernel from ForceKernel.h. list is per-thread scratch
+    Vec2 acc(Vec2 pos, InteractionList& list, double accMag = 0.0, uint32_t* interactions = nullptr) const;
+
+    // Whether each leaf knows which bodies it holds (Morton builders and refit, not insert())
+    bool hasBodyOrder() const { return m_hasBodyOrder; }
+
+    // Body index of every sorted slot, valid while hasBodyOrder()
+    const FieldVector<uint32_t>& getBodyOrder() const { return m_order; }
+
+    // Forget which leaf holds each body, e.g. after the body vector was permuted, so the
+    // next refit() asks for a full rebuild instead of reading stale indices
+    void invalidateLeafIndex() { m_leavesIndexed = false; m_hasBodyOrder = false; }
+
+    // Split the tree into groups: the largest subtrees holding at most maxBodies bodies, or
+    // single leaves holding more. Needs hasBodyOrder(), otherwise no groups are made
+    void buildGroups(size_t maxBodies);
+    size_t getGroupCount() const { return m_groups.size(); }
+
+    // Walk the tree once for every body of a group, opening nodes against the group's bounding
+    // box, and set the acceleration of those bodies. The relative criterion uses the smallest
+    // last-step acceleration in the group. list is scratch space for the walk.
+    // With a list skin the walk is replaced by the group's cached list when possible
+    void accGroup(size_t group, BodyStore& bodies, InteractionList& list);
+
+    // Keep each group's accepted nodes between steps and only re-read their masses and centers
+    // of mass, skipping the walk. A list is walked again once the topology changes (any full
+    // build, so in practice this needs TreeBuilder::Refit), a group's bodies leave the box the
+    // list was made for, which is padded by skin times the group's cell size, one of its far
+    // nodes no longer passes the opening test from that box, or it has been reused
+    // m_maxListAge times. 0 turns reuse off
+    double getListSkin() const { return m_listSkin; }
+    void setListSkin(double skin);
+
+    // Fraction of groups whose last accGroup reused its list
+    double getListReuseRate() const;
+
+    // Interactions per body of the last accGroup calls, i.e. the size of the list each body was
+    // summed against. Differs from the per-body acc() walk, as a group opens nodes for its box
+    double getGroupInteractionsPerBody() const;
 
     // Render the quadtree (for debugging)
     void render() const;
 
     double getTheta() const;
     void setTheta(double theta);
+
+    const std::vector<Node>& getNodes() const { return m_nodes; }
+    const std::vector<Cell>& getCells() const { return m_cells; }
+
+    // Bodies of bucket leaves, a bucket leaf's range starts at (children & ~LEAF_BUCKET)
+    const std::vector<Vec2>& getSortedPositions() const { return m_sortedPos; }
+    const FieldVector<double>& getSortedMasses() const { return m_sortedMass; }
+
+    // Add quadrupole corrections for accepted cells, so higher theta keeps the same accuracy
+    bool getQuadrupole() const { return m_quadrupole; }
+    void setQuadrupole(bool enabled) { m_quadrupole = enabled; }
+
+    // Evaluate accepted far nodes in single precision (twice the SIMD width) in the batched
+    // acc(pos, list) and accGroup paths. Leaves and nearby bodies always stay in double
+    bool getMixedPrecision() const { return m_mixedPrecision; }
+    void setMixedPrecision(bool enabled) { m_mixedPrecision = enabled; }
+
+    // Takes effect at the next propagation. Switching back to Geometric drops the refit
+    // index, since refitted nodes would keep their bmax otherwise
+    OpeningCriterion getOpeningCriterion() const { return m_criterion; }
+    void setOpeningCriterion(OpeningCriterion criterion);
+
+    // Bodies a leaf may hold before it is split. Only the Morton-based builders and refit
+    // honour it; insert() always stores one position per leaf
+    size_t getLeafCapacity() const { return m_leafCapacity; }
+    void setLeafCapacity(size_t capacity);
+
+    // Move the arrays indexed by sorted body onto the NUMA nodes of the pool's workers, see
+    // ::placeOnWorkers. Nodes and sorted positions stay where they are: every walk reads the
+    // top of the tree, and Vec2 and Node construct their elements when the arrays grow
+    void placeOnWorkers(ThreadPool& pool, size_t grain);
+
+    int getSplitLevels() const { return m_splitLevels; }
+    void setSplitLevels(int levels);
 };
 
 #endif // QUADTREE_H
@@ -0,0 +1,132 @@
+#include "Topology.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sched.h>
+#elif defined(_WIN32)
+// Keep windows.h from defining min/max macros over std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+#if defined(__linux__)
+// Affinity of the process when it first asked, before any worker was pinned
+static const cpu_set_t& startingAffinity() {
+    static const cpu_set_t mask = [] {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &set);
+        }
+        return set;
+    }();
+    return mask;
+}
+#endif
+
+std::vector<int> CpuTopology::parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        } catch (const std::exception&) {
+            // Not a number, skip the entry
+        }
+    }
+    return cpus;
+}
+
+CpuTopology CpuTopology::detect() {
+    CpuTopology topology;
+
+#if defined(__linux__)
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodeList;
+    if (online && std::getline(online, nodeList)) {
+        const cpu_set_t& allowed = startingAffinity();
+        for (int node : parseCpuList(nodeList)) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string cpuList;
+            if (!file || !std::getline(file, cpuList)) continue;
+
+            std::vector<int> cpus;
+            for (int cpu : parseCpuList(cpuList)) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+            }
+            // Memory-only nodes and nodes outside our cpuset have nothing to pin to
+            if (!cpus.empty()) topology.nodes.push_back(cpus);
+        }
+    }
+#endif
+
+    if (topology.nodes.empty()) {
+        unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        topology.nodes.emplace_back();
+        for (unsigned cpu = 0; cpu < count; ++cpu) topology.nodes[0].push_back(static_cast<int>(cpu));
+    }
+    return topology;
+}
+
+size_t CpuTopology::cpuCount() const {
+    size_t count = 0;
+    for (const std::vector<int>& cpus : nodes) count += cpus.size();
+    return count;
+}
+
+std::vector<int> CpuTopology::workerCpus(size_t count) const {
+    std::vector<int> cpus;
+    size_t total = cpuCount();
+    if (total == 0) return cpus;
+
+    // Node k takes workers [count * before / total, count * (before + its CPUs) / total)
+    size_t before = 0;
+    for (const std::vector<int>& node : nodes) {
+        size_t first = count * before / total;
+        before += node.size();
+        size_t last = count * before / total;
+        for (size_t w = first; w < last; ++w) {
+            cpus.push_back(node[(w - first) % node.size()]);
+        }
+    }
+    return cpus;
+}
+
+bool pinCurrentThread(int cpu) {
+#if defined(__linux__)
+    // Read before the first pin, so it is never a pinned thread's mask
+    const cpu_set_t& starting = startingAffinity();
+    cpu_set_t set;
+    if (cpu < 0) {
+        set = starting;
+    } else {
+        if (cpu >= CPU_SETSIZE) return false;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR processMask = 0;
+    DWORD_PTR systemMask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) return false;
+    if (cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8)) return false;
+    DWORD_PTR mask = cpu < 0 ? processMask : (DWORD_PTR(1) << cpu);
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -0,0 +1,30 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// CPUs grouped by NUMA node, read from /sys/devices/system/node on Linux and limited to the
+// CPUs this process may run on. Where there is no /sys, or it lists no nodes, every
+// hardware_concurrency() CPU is put in one node
+struct CpuTopology {
+    std::vector<std::vector<int>> nodes; // CPU numbers of each node
+
+    static CpuTopology detect();
+
+    size_t cpuCount() const;
+
+    // CPU for each of count workers. Every node gets a share of the workers in proportion to
+    // its CPUs, in one consecutive run, so workers with neighbouring indices (which take
+    // neighbouring ranges of a static loop) share a node. CPUs are reused past cpuCount()
+    std::vector<int> workerCpus(size_t count) const;
+
+    // CPU numbers of a /sys list such as "0-3,8-11"
+    static std::vector<int> parseCpuList(const std::string& list);
+};
+
+// Keep the calling thread on one CPU, or with cpu < 0 let it run on any CPU the process was
+// started with again. False if the platform refused or has no thread affinity
+bool pinCurrentThread(int cpu);
+
+#endif // TOPOLOGY_H
@@ -1,23 +1,104 @@
 #ifndef VEC2
 #define VEC2
 #include <cmath>
+#include <limits>
+#include <array>
+#include <cstddef>
+
+// D dimensional math vector. The 2D one is written out by hand below, so code using Vec2
+// compiles exactly as it did before the vector became generic
+template <size_t D>
+class Vec
+{
+    std::array<double, D> c {};
+
+    public:
+    Vec() = default;
+
+    // One coordinate per dimension, Vec<3>(x, y, z)
+    template <typename... T, typename = typename std::enable_if<sizeof...(T) == D>::type>
+    explicit Vec(T... coords) : c{{static_cast<double>(coords)...}} {}
+
+    Vec operator+(const Vec& rhs) const {
+        Vec out;
+        for (size_t d = 0; d < D; ++d) out.c[d] = c[d] + rhs.c[d];
+        return out;
+    }
+
+    Vec& operator+=(const Vec& rhs) {
+        for (size_t d = 0; d < D; ++d) c[d] += rhs.c[d];
+        return *this;
+    }
+
+    Vec operator-(const Vec& rhs) const {
+        Vec out;
+        for (size_t d = 0; d < D; ++d) out.c[d] = c[d] - rhs.c[d];
+        return out;
+    }
+
+    Vec& operator-=(const Vec& rhs) {
+        for (size_t d = 0; d < D; ++d) c[d] -= rhs.c[d];
+        return *this;
+    }
+
+    Vec operator*(double mult) const {
+        Vec out;
+        for (size_t d = 0; d < D; ++d) out.c[d] = c[d] * mult;
+        return out;
+    }
+
+    Vec operator/(double div) const {
+        Vec out;
+        for (size_t d = 0; d < D; ++d) out.c[d] = c[d] / div;
+        return out;
+    }
+
+    double operator[](size_t d) const { return c[d]; }
+    double& operator[](size_t d) { return c[d]; }
+
+    void zero() { c.fill(0.0); }
+
+    double dot(const Vec& rhs) const {
+        double sum = 0.0;
+        for (size_t d = 0; d < D; ++d) sum += c[d] * rhs.c[d];
+        return sum;
+    }
+
+    double magSqrd() const { return dot(*this); }
+    double mag() const { return std::sqrt(magSqrd()); }
+
+    Vec normalized() const {
+        double magnitude = mag();
+        if (magnitude < std::numeric_limits<double>::epsilon() * 100) {
+            return Vec();
+        }
+        return *this / magnitude;
+    }
+
+    friend bool operator==(const Vec& lhs, const Vec& rhs) { return lhs.c == rhs.c; }
+    friend bool operator!=(const Vec& lhs, const Vec& rhs) { return !(lhs == rhs); }
+};
+
+using Vec2 = Vec<2>;
+using Vec3 = Vec<3>;
 
 // 2 demensional math vector class
-class Vec2
+template <>
+class Vec<2>
 {
     double x {};
     double y {};
 
     public:
-    Vec2() = default;
-    Vec2(double x, double y) : x(x), y(y) {}
-    Vec2(const Vec2& rhs) : x(rhs.x), y(rhs.y) {}
+    Vec() = default;
+    Vec(double x, double y) : x(x), y(y) {}
+    Vec(const Vec2& rhs) : x(rhs.x), y(rhs.y) {}
     Vec2& operator=(const Vec2& rhs) {
         x = rhs.x;
         y = rhs.y;
         return *this;
     }
-    ~Vec2() = default;
+    ~Vec() = default;
 
     Vec2 operator+(const Vec2& rhs) const {
         return Vec2(x + rhs.x, y + rhs.y);
@@ -53,7 +134,7 @@ class Vec2
     }
 
     double mag() const {
-        return std::sqrtl(std::powl(x, 2) + std::powl(y, 2));
+        return std::sqrt(x*x + y*y);
     }
     
     inline double magSqrd() const {
@@ -86,6 +167,15 @@ class Vec2
         return y;
     }
 
+    // Coordinate by axis, for code written for any dimension
+    inline double operator[](size_t d) const {
+        return d == 0 ? x : y;
+    }
+
+    inline double& operator[](size_t d) {
+        return d == 0 ? x : y;
+    }
+
     // Setters
 
     inline void setX(double newX) {